@@ -17,21 +17,76 @@
 // Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 //
 
+#include <pthread.h>
 #include <algorithm>
+#include <map>
 #include <queue>
+#include <set>
 #include <sstream>
 #include <utility>
 #include "analyzer.h"
 
+namespace {
+
+/* expected similarity of a document to the drift of a composite vector */
+const double DRIFT_SIMILARITY = 0.1;
+
+/**
+ * Get the hash value of a key and a seed.
+ */
+unsigned long long hash_key(bayon::VecKey key, unsigned long long seed) {
+  // the finalizer of MurmurHash3
+  unsigned long long h = static_cast<unsigned long long>(key)
+                         + seed * 0x9e3779b97f4a7c15ULL;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/* documents assigned to the nearest centroids by a thread */
+struct AssignmentJob {
+  const std::vector<bayon::Document *> *documents;  // all documents
+  const std::vector<bayon::Vector *> *centroids;    // centroid vectors
+  std::vector<unsigned int> *labels;                // output labels
+  size_t begin;                                     // first document
+  size_t end;                                       // end of documents
+};
+
+/**
+ * Assign documents to the nearest centroids.
+ */
+void *assign_documents(void *arg) {
+  AssignmentJob *job = static_cast<AssignmentJob *>(arg);
+  for (size_t i = job->begin; i < job->end; i++) {
+    double max_similarity = -1.0;
+    size_t max_index = 0;
+    for (size_t j = 0; j < job->centroids->size(); j++) {
+      double similarity = bayon::Vector::inner_product(
+        *(*job->documents)[i]->feature(), *(*job->centroids)[j]);
+      if (max_similarity < similarity) {
+        max_similarity = similarity;
+        max_index = j;
+      }
+    }
+    (*job->labels)[i] = static_cast<unsigned int>(max_index);
+  }
+  return NULL;
+}
+
+} /* namespace */
+
 namespace bayon {
 
-const unsigned int Analyzer::NUM_REFINE_LOOP;
+const unsigned int Analyzer::DEFAULT_REFINE_LOOP;
 
 /**
  * Do repeated bisection clustering.
  */
 size_t Analyzer::repeated_bisection() {
-  Cluster *cluster = new Cluster();
+  Cluster *cluster = pool_.get();
   cluster->set_seed(seed_);
   for (size_t i = 0; i < documents_.size(); i++) {
     cluster->add_document(documents_[i]);
@@ -40,92 +95,349 @@ size_t Analyzer::repeated_bisection() {
   std::priority_queue<Cluster *,
                       std::vector<Cluster *>,
                       CompareClusterBisectionEvalGreater> que;
-  cluster->section(2);
-  refine_clusters(cluster->sectioned_clusters());
-  cluster->set_sectioned_gain();
-  cluster->composite_vector()->clear();
+  bisect(cluster, branch_size_);
   que.push(cluster);
 
+  // the index of the tree node of each cluster
+  std::map<Cluster *, long> nodes;
+  tree_.clear();
+  if (tree_flag_) {
+    nodes[cluster] = 0;
+    tree_.push_back(TreeNode());
+    tree_.back().parent = -1;
+    tree_.back().cluster = -1;
+    tree_.back().gain = 0.0;
+  }
+
+  // clusters whose gains are estimated with samples
+  std::set<Cluster *> estimated;
+
   std::stringstream ss;
   while (!que.empty()) {
     if (limit_nclusters_ > 0 && que.size() >= limit_nclusters_) break;
     cluster = que.top();
-    if (cluster->sectioned_clusters().size() < 1) break;
-    if (limit_eval_ > 0 && cluster->sectioned_gain() < limit_eval_) break;
     que.pop();
+    // a cluster of an estimated gain is bisected when it is chosen, and
+    // competes again with its exact gain
+    if (estimated.erase(cluster) > 0) {
+      bisect(cluster, branch_size_);
+      que.push(cluster);
+      continue;
+    }
+    if (cluster->sectioned_clusters().size() < 1
+        || (limit_eval_ > 0 && cluster->sectioned_gain() < limit_eval_)) {
+      que.push(cluster);
+      break;
+    }
+    // divide the last cluster into fewer clusters within the limit
+    if (limit_nclusters_ > 0 && que.size() + cluster->sectioned_clusters().size()
+                                > limit_nclusters_) {
+      for (size_t i = 0; i < cluster->sectioned_clusters().size(); i++) {
+        pool_.release(cluster->sectioned_clusters()[i]);
+      }
+      cluster->sectioned_clusters().clear();
+      bisect(cluster, limit_nclusters_ - que.size());
+    }
+    if (reorder_flag_ && !projected_.empty()) reorder_documents(cluster);
     std::vector<Cluster *> sectioned = cluster->sectioned_clusters();
 
     // for debug
     ss << "que_size: " << que.size() << "\tcluster_size: " << cluster->size()
-       << "\tsectioned: " << sectioned[0]->size() << ", "
-       << sectioned[1]->size() << "\tgain: " << cluster->sectioned_gain();
+       << "\tsectioned:";
+    for (size_t i = 0; i < sectioned.size(); i++) {
+      ss << (i > 0 ? ", " : " ") << sectioned[i]->size();
+    }
+    ss << "\tgain: " << cluster->sectioned_gain();
     show_log(ss.str());
     ss.str("");
 
     for (size_t i = 0; i < sectioned.size(); i++) {
-      sectioned[i]->section(2);
-      refine_clusters(sectioned[i]->sectioned_clusters());
-      sectioned[i]->set_sectioned_gain();
-      if (sectioned[i]->sectioned_gain() < limit_eval_) {
-        for (size_t j = 0; j < sectioned[i]->sectioned_clusters().size(); j++) {
-          sectioned[i]->sectioned_clusters()[j]->clear();
-        }
+      if (lazy_sample_size_ > 0 && sectioned[i]->size() > lazy_sample_size_) {
+        estimate_sectioned_gain(sectioned[i]);
+        estimated.insert(sectioned[i]);
+      } else {
+        bisect(sectioned[i], branch_size_);
       }
-      sectioned[i]->composite_vector()->clear();
       que.push(sectioned[i]);
     }
-    delete cluster;
+    if (tree_flag_) {
+      long parent = nodes[cluster];
+      Vector &centroid = tree_[parent].centroid;
+      for (size_t i = 0; i < cluster->documents().size(); i++) {
+        centroid.add_vector(*cluster->documents()[i]->feature());
+      }
+      centroid.normalize();
+      tree_[parent].gain = cluster->sectioned_gain();
+      for (size_t i = 0; i < sectioned.size(); i++) {
+        nodes[sectioned[i]] = tree_.size();
+        tree_.push_back(TreeNode());
+        tree_.back().parent = parent;
+        tree_.back().cluster = -1;
+        tree_.back().gain = 0.0;
+      }
+      nodes.erase(cluster);
+    }
+    pool_.release(cluster);
   }
   while (!que.empty()) {
     clusters_.push_back(que.top());
     que.pop();
   }
   std::reverse(clusters_.begin(), clusters_.end());
+  if (tree_flag_) {
+    for (size_t i = 0; i < clusters_.size(); i++) {
+      tree_[nodes[clusters_[i]]].cluster = i;
+    }
+  }
   return clusters_.size();
 }
 
+/**
+ * Bisect a cluster and set the gain of the bisection.
+ */
+void Analyzer::bisect(Cluster *cluster, size_t nclusters) {
+  cluster->set_sectioned_gain(0.0);  // drop an estimated gain
+  if (bisection_sample_size_ > 0 && cluster->size() > bisection_sample_size_
+      && section_by_sample(cluster, nclusters)) {
+    refine_clusters(cluster->sectioned_clusters(), sample_refine_loop_);
+  } else {
+    // a small cluster is divided into as many clusters as its documents
+    nclusters = std::min(nclusters, cluster->size());
+    if (nclusters > 1) cluster->section(nclusters);
+    refine_clusters(cluster->sectioned_clusters(), refine_loop_);
+  }
+  cluster->set_sectioned_gain();
+  if (cluster->sectioned_gain() < limit_eval_) {
+    for (size_t i = 0; i < cluster->sectioned_clusters().size(); i++) {
+      cluster->sectioned_clusters()[i]->clear();
+    }
+  }
+  cluster->composite_vector()->clear();
+}
+
+/**
+ * Section a cluster by the centroids of bisected sampled documents.
+ */
+bool Analyzer::section_by_sample(Cluster *cluster, size_t nclusters) {
+  std::vector<Document *> docs;
+  cluster->choose_randomly(std::max(bisection_sample_size_, nclusters), docs);
+  Cluster *sample = pool_.get();
+  sample->set_seed(seed_);
+  for (size_t i = 0; i < docs.size(); i++) {
+    sample->add_document(docs[i]);
+  }
+  sample->section(nclusters);
+  if (sample->sectioned_clusters().size() < nclusters) {
+    for (size_t i = 0; i < sample->sectioned_clusters().size(); i++) {
+      pool_.release(sample->sectioned_clusters()[i]);
+    }
+    pool_.release(sample);
+    return false;
+  }
+  refine_clusters(sample->sectioned_clusters(), refine_loop_);
+
+  std::vector<Vector *> centroids;
+  for (size_t i = 0; i < sample->sectioned_clusters().size(); i++) {
+    centroids.push_back(sample->sectioned_clusters()[i]->centroid_vector());
+  }
+
+  // assign all documents to the nearest centroids in parallel
+  const std::vector<Document *> &documents = cluster->documents();
+  std::vector<unsigned int> labels(documents.size(), 0);
+  size_t nthreads = std::max(std::min(thread_size_, documents.size()),
+                             static_cast<size_t>(1));
+  std::vector<AssignmentJob> jobs(nthreads);
+  std::vector<pthread_t> threads(nthreads);
+  std::vector<bool> created(nthreads, false);
+  for (size_t i = 0; i < nthreads; i++) {
+    jobs[i].documents = &documents;
+    jobs[i].centroids = &centroids;
+    jobs[i].labels = &labels;
+    jobs[i].begin = documents.size() * i / nthreads;
+    jobs[i].end = documents.size() * (i + 1) / nthreads;
+    if (i > 0) {
+      created[i] =
+        pthread_create(&threads[i], NULL, assign_documents, &jobs[i]) == 0;
+    }
+  }
+  // jobs of threads not created are done by this thread
+  for (size_t i = 0; i < nthreads; i++) {
+    if (!created[i]) assign_documents(&jobs[i]);
+  }
+  for (size_t i = 1; i < nthreads; i++) {
+    if (created[i]) pthread_join(threads[i], NULL);
+  }
+
+  for (size_t i = 0; i < centroids.size(); i++) {
+    Cluster *sectioned = pool_.get();
+    sectioned->set_seed(seed_);
+    cluster->sectioned_clusters().push_back(sectioned);
+  }
+  for (size_t i = 0; i < documents.size(); i++) {
+    if (cluster->removed(i)) continue;
+    cluster->sectioned_clusters()[labels[i]]->add_document(documents[i]);
+  }
+  for (size_t i = 0; i < sample->sectioned_clusters().size(); i++) {
+    pool_.release(sample->sectioned_clusters()[i]);
+  }
+  pool_.release(sample);
+  return true;
+}
+
+/**
+ * Estimate the gain of the bisection of a cluster with sampled documents.
+ */
+void Analyzer::estimate_sectioned_gain(Cluster *cluster) {
+  // sampling does not change the bisection of the cluster
+  std::vector<Document *> docs;
+  unsigned int seed = cluster->seed();
+  cluster->choose_randomly(lazy_sample_size_, docs);
+  cluster->set_seed(seed);
+  Cluster *sample = pool_.get();
+  sample->set_seed(seed_);
+  for (size_t i = 0; i < docs.size(); i++) {
+    sample->add_document(docs[i]);
+  }
+  size_t nclusters = std::min(branch_size_, sample->size());
+  if (nclusters > 1) sample->section(nclusters);
+  refine_clusters(sample->sectioned_clusters(), refine_loop_);
+  sample->set_sectioned_gain();
+  // norms of composite vectors grow with the number of documents
+  cluster->set_sectioned_gain(
+    sample->sectioned_gain() * cluster->size() / docs.size());
+  for (size_t i = 0; i < sample->sectioned_clusters().size(); i++) {
+    pool_.release(sample->sectioned_clusters()[i]);
+  }
+  pool_.release(sample);
+}
+
 /**
  * Refine clustering results.
  */
-double Analyzer::refine_clusters(std::vector<Cluster *> &clusters) {
+double Analyzer::refine_clusters(std::vector<Cluster *> &clusters,
+                                 unsigned int max_loop) {
+  // composite vectors of projected documents
+  size_t dim = projected_.empty() ? 0 : projection_dim_;
+  std::vector<double> &composites = refine_composites_;
+  composites.assign(clusters.size() * dim, 0.0);
+  std::vector<double> projected_norms(dim > 0 ? clusters.size() : 0, 0.0);
+  for (size_t i = 0; i < clusters.size() && dim > 0; i++) {
+    double *composite = &composites[i * dim];
+    for (size_t j = 0; j < clusters[i]->documents().size(); j++) {
+      const double *row =
+        &projected_[document_slot(clusters[i]->documents()[j]) * dim];
+      for (size_t k = 0; k < dim; k++) composite[k] += row[k];
+    }
+    double sum = 0.0;
+    for (size_t k = 0; k < dim; k++) sum += composite[k] * composite[k];
+    projected_norms[i] = sqrt(sum);
+  }
+
   double norms[clusters.size()];
   for (size_t i = 0; i < clusters.size(); i++) {
     norms[i] = clusters[i]->composite_vector()->norm();
   }
 
+  // each document has the label of its cluster, and moved documents
+  // update composite vectors directly instead of membership lists
+  std::vector<Document *> &docs = refine_documents_;
+  std::vector<unsigned int> &labels = refine_labels_;
+  std::vector<const double *> &rows = refine_rows_;
+  docs.clear();
+  labels.clear();
+  rows.clear();
+  std::vector<Vector *> composite_vectors(clusters.size());
+  for (size_t i = 0; i < clusters.size(); i++) {
+    composite_vectors[i] = clusters[i]->composite_vector();
+    for (size_t j = 0; j < clusters[i]->documents().size(); j++) {
+      if (clusters[i]->removed(j)) continue;
+      Document *doc = clusters[i]->documents()[j];
+      docs.push_back(doc);
+      labels.push_back(static_cast<unsigned int>(i));
+      if (dim > 0) rows.push_back(&projected_[document_slot(doc) * dim]);
+    }
+  }
+
+  // documents are visited in a shuffled order of the membership lists,
+  // or in the order of their storage with the active set
+  std::vector<std::vector<size_t> > members(clusters.size());
+  std::vector<std::vector<size_t> > arrived(clusters.size());
+  for (size_t i = 0; i < docs.size(); i++) members[labels[i]].push_back(i);
+  std::vector<size_t> &order = refine_order_;
   Random r(seed_);
+
+  // a document is out of the active set while the margin of its best
+  // move exceeds the drifts of composite vectors since it was checked,
+  // so each bound keeps the margin plus the drifts at the check
+  std::vector<double> &bounds = refine_bounds_;
+  bounds.assign(docs.size(), 0.0);
+  std::vector<double> drifts(clusters.size(), 0.0);
+  double drift_max = 0.0;
+  std::vector<size_t> moves(clusters.size(), 0);
+
   double eval_cluster = 0.0;
   unsigned int loop_count = 0;
-  while (loop_count++ < NUM_REFINE_LOOP) {
-    std::vector<std::pair<size_t, size_t> > items;
-    for (size_t i = 0; i < clusters.size(); i++) {
-      for (size_t j = 0; j < clusters[i]->documents().size(); j++) {
-        items.push_back(std::pair<size_t, size_t>(i, j));
+  bool moved = false;
+  bool all = true;
+  while (loop_count++ < max_loop) {
+    order.clear();
+    if (refine_active_set_) {
+      for (size_t i = 0; i < docs.size(); i++) order.push_back(i);
+    } else {
+      for (size_t i = 0; i < members.size(); i++) {
+        order.insert(order.end(), members[i].begin(), members[i].end());
       }
+      random_shuffle(order.begin(), order.end(), r);
     }
-    random_shuffle(items.begin(), items.end(), r);
 
     bool changed = false;
-    for (size_t i = 0; i < items.size(); i++) {
-      size_t cluster_id = items[i].first;
-      size_t item_id    = items[i].second;
-      Document *doc = clusters[cluster_id]->documents()[item_id];
+    double eval_loop = 0.0;
+    for (size_t n = 0; n < order.size(); n++) {
+      size_t i = order[n];
+      size_t cluster_id = labels[i];
+      if (!all && bounds[i] > drifts[cluster_id] + drift_max) continue;
+      Document *doc = docs[i];
+
+      // choose a candidate with projected vectors and verify it below
+      const double *row = NULL;
+      size_t candidate = clusters.size();
+      double projected_base_moved = 0.0, projected_max = 0.0;
+      if (dim > 0) {
+        row = rows[i];
+        projected_base_moved = moved_norm(
+          projected_norms[cluster_id],
+          projected_vector_value(&composites[cluster_id * dim], row, -1));
+        double eval_max = 0.0;
+        for (size_t j = 0; j < clusters.size(); j++) {
+          if (cluster_id == j) continue;
+          double norm_target_moved = moved_norm(
+            projected_norms[j],
+            projected_vector_value(&composites[j * dim], row, 1));
+          double eval_moved = projected_base_moved + norm_target_moved
+                              - projected_norms[cluster_id]
+                              - projected_norms[j];
+          if (eval_max < eval_moved) {
+            eval_max = eval_moved;
+            projected_max = norm_target_moved;
+            candidate = j;
+          }
+        }
+        if (candidate == clusters.size()) continue;
+      }
 
       double value_base = refined_vector_value(
-        *clusters[cluster_id]->composite_vector(), *doc->feature(), -1);
-      double norm_base_moved = pow(norms[cluster_id], 2) + value_base;
-      norm_base_moved = norm_base_moved > 0 ? sqrt(norm_base_moved) : 0.0;
+        *composite_vectors[cluster_id], *doc->feature(), -1);
+      double norm_base_moved = moved_norm(norms[cluster_id], value_base);
 
       double eval_max = -1.0;
       double norm_max = 0.0;
       size_t max_index = 0;
       for (size_t j = 0; j < clusters.size(); j++) {
         if (cluster_id == j) continue;
+        if (row && j != candidate) continue;
         double value_target = refined_vector_value(
-          *clusters[j]->composite_vector(), *doc->feature(), 1);
-        double norm_target_moved = pow(norms[j], 2) + value_target;
-        norm_target_moved = norm_target_moved > 0 ?
-          sqrt(norm_target_moved) : 0.0;
+          *composite_vectors[j], *doc->feature(), 1);
+        double norm_target_moved = moved_norm(norms[j], value_target);
         double eval_moved = norm_base_moved + norm_target_moved
                             - norms[cluster_id] - norms[j];
         if (eval_max < eval_moved) {
@@ -135,17 +447,78 @@ double Analyzer::refine_clusters(std::vector<Cluster *> &clusters) {
         }
       }
       if (eval_max > 0) {
-        eval_cluster += eval_max;
-        clusters[max_index]->add_document(doc);
-        clusters[cluster_id]->remove_document(item_id);
+        eval_loop += eval_max;
+        composite_vectors[max_index]->add_vector(*doc->feature());
+        composite_vectors[cluster_id]->delete_vector(*doc->feature());
+        moves[max_index]++;
+        moves[cluster_id]++;
+        bounds[i] = 0.0;
+        labels[i] = static_cast<unsigned int>(max_index);
+        arrived[max_index].push_back(i);
         norms[cluster_id] = norm_base_moved;
         norms[max_index] = norm_max;
+        if (row) {
+          for (size_t k = 0; k < dim; k++) {
+            composites[max_index * dim + k] += row[k];
+            composites[cluster_id * dim + k] -= row[k];
+          }
+          projected_norms[cluster_id] = projected_base_moved;
+          projected_norms[max_index] = projected_max;
+        }
         changed = true;
+      } else if (!row) {
+        bounds[i] = drifts[cluster_id] + drift_max - eval_max;
+      }
+    }
+    eval_cluster += eval_loop;
+    if (!changed) {
+      if (all) break;
+      all = true;  // verify the convergence with all documents
+      continue;
+    }
+    moved = true;
+
+    // moved documents follow the others in the membership lists
+    for (size_t j = 0; j < clusters.size(); j++) {
+      size_t n = 0;
+      for (size_t k = 0; k < members[j].size(); k++) {
+        if (labels[members[j][k]] == j) members[j][n++] = members[j][k];
       }
+      members[j].resize(n);
+      members[j].insert(members[j].end(), arrived[j].begin(), arrived[j].end());
+      arrived[j].clear();
     }
-    if (!changed) break;
+
+    // normalized documents moved in different directions drift a composite
+    // vector by about the square root of their number, and the gain of
+    // a move changes by the similarity of the document to the drift
+    // over the norm of the composite vector
+    double loop_max = 0.0;
+    double norm_sum = 0.0;
+    for (size_t j = 0; j < clusters.size(); j++) {
+      double drift = sqrt(static_cast<double>(moves[j]));
+      double base = norms[j] - drift - 1.0;
+      drift = base > 0 ? DRIFT_SIMILARITY * drift / base : HUGE_VAL;
+      drifts[j] += drift;
+      loop_max = std::max(loop_max, drift);
+      norm_sum += norms[j];
+      moves[j] = 0;
+    }
+    drift_max += loop_max;
+    // a small gain in the active set is verified with all documents
+    bool converged = eval_loop < refine_tolerance_ * norm_sum;
+    if (converged && all) break;
+    all = converged || !refine_active_set_;
+  }
+
+  // rebuild the documents of clusters from the membership lists
+  if (moved) {
     for (size_t i = 0; i < clusters.size(); i++) {
-      clusters[i]->refresh();
+      std::vector<Document *> documents;
+      for (size_t j = 0; j < members[i].size(); j++) {
+        documents.push_back(docs[members[i][j]]);
+      }
+      clusters[i]->set_documents(documents);
     }
   }
   return eval_cluster;
@@ -162,6 +535,100 @@ double Analyzer::refined_vector_value(const Vector &composite,
   return sum;
 }
 
+double Analyzer::moved_norm(double norm, double value) const {
+  double squared = norm * norm + value;
+  return squared > 0 ? sqrt(squared) : 0.0;
+}
+
+double Analyzer::projected_vector_value(const double *composite,
+                                        const double *vec, int sign) const {
+  // contiguous loop, vectorized by the compiler
+  double sum = 0.0;
+  for (size_t i = 0; i < projection_dim_; i++) {
+    sum += vec[i] * (vec[i] + sign * 2 * composite[i]);
+  }
+  return sum;
+}
+
+/**
+ * Project documents into dense vectors by a very sparse random projection.
+ */
+void Analyzer::project_documents() {
+  projected_.clear();
+  if (projection_dim_ == 0) return;
+
+  // very sparse projection: 1 / sqrt(the number of keys) of elements
+  // are nonzero, which is the same number in each key here
+  HashMap<VecKey, size_t>::type df;
+  init_hash_map(VECTOR_EMPTY_KEY, df);
+  count_df(df);
+  size_t nonzeros = static_cast<size_t>(
+    ceil(projection_dim_ / sqrt(static_cast<double>(df.size() + 1))));
+  nonzeros = std::min(std::max(nonzeros, static_cast<size_t>(1)),
+                      projection_dim_);
+  double scale = 1.0 / sqrt(static_cast<double>(nonzeros));
+
+  projected_.resize(documents_.size() * projection_dim_, 0.0);
+  for (size_t i = 0; i < documents_.size(); i++) {
+    double *row = &projected_[i * projection_dim_];
+    const VecHashMap *hmap = documents_[i]->feature()->hash_map();
+    for (VecHashMap::const_iterator it = hmap->begin();
+         it != hmap->end(); ++it) {
+      for (size_t j = 0; j < nonzeros; j++) {
+        unsigned long long h = hash_key(it->first, seed_ + j + 1);
+        double value = (h >> 63) ? -scale : scale;
+        row[(h & 0x7fffffffffffffffULL) % projection_dim_] +=
+          value * it->second;
+      }
+    }
+    // documents are normalized in clusters
+    double sum = 0.0;
+    for (size_t k = 0; k < projection_dim_; k++) sum += row[k] * row[k];
+    if (sum > 0) {
+      double norm = sqrt(sum);
+      for (size_t k = 0; k < projection_dim_; k++) row[k] /= norm;
+    }
+  }
+}
+
+/**
+ * Reorder the documents of a cluster in the order of its sectioned clusters.
+ */
+void Analyzer::reorder_documents(Cluster *cluster) {
+  std::vector<Cluster *> &sectioned = cluster->sectioned_clusters();
+  size_t dim = projected_.empty() ? 0 : projection_dim_;
+  std::vector<Document *> all;
+  std::vector<size_t> slots;
+  for (size_t i = 0; i < sectioned.size(); i++) {
+    std::vector<Document *> docs;
+    for (size_t j = 0; j < sectioned[i]->documents().size(); j++) {
+      if (sectioned[i]->removed(j)) continue;
+      Document *doc = sectioned[i]->documents()[j];
+      docs.push_back(doc);
+      all.push_back(doc);
+      slots.push_back(document_slot(doc));
+    }
+    sectioned[i]->set_documents(docs);
+  }
+
+  // the slots of a cluster are contiguous if those of its parent are
+  std::vector<double> moved(all.size() * dim);
+  for (size_t i = 0; i < all.size() && dim > 0; i++) {
+    std::copy(&projected_[slots[i] * dim], &projected_[slots[i] * dim] + dim,
+              &moved[i * dim]);
+  }
+  std::sort(slots.begin(), slots.end());
+  for (size_t i = 0; i < all.size(); i++) {
+    documents_[slots[i]] = all[i];
+    document_slots_[reinterpret_cast<size_t>(all[i])] = slots[i];
+    if (dim > 0) {
+      std::copy(&moved[i * dim], &moved[i * dim] + dim,
+                &projected_[slots[i] * dim]);
+    }
+  }
+  cluster->set_documents(all);
+}
+
 /**
  * Count document frequency(DF) of the features in documents.
  */
@@ -176,6 +643,58 @@ void Analyzer::count_df(HashMap<VecKey, size_t>::type &df) const {
   }
 }
 
+/**
+ * Count document frequency(DF) of the features in documents into a sketch.
+ */
+void Analyzer::count_df(CountMinSketch &df) const {
+  for (size_t i = 0; i < documents_.size(); i++) {
+    VecHashMap *hmap = documents_[i]->feature()->hash_map();
+    for (VecHashMap::iterator it = hmap->begin();
+         it != hmap->end(); ++it) {
+      df.add(it->first);
+    }
+  }
+}
+
+/**
+ * Remove features by document frequency and renumber keys.
+ */
+size_t Analyzer::prune_features(size_t min_df, size_t max_df,
+                                HashMap<VecKey, VecKey>::type &keymap,
+                                bool df_order) {
+  HashMap<VecKey, size_t>::type df;
+  init_hash_map(VECTOR_EMPTY_KEY, df);
+  count_df(df);
+  std::vector<std::pair<VecKey, size_t> > keys;
+  for (HashMap<VecKey, size_t>::type::iterator it = df.begin();
+       it != df.end(); ++it) {
+    if (it->second >= min_df && it->second <= max_df) {
+      keys.push_back(*it);
+    }
+  }
+  if (df_order) {
+    std::sort(keys.begin(), keys.end(), greater_pair<VecKey, size_t>);
+  } else {
+    std::sort(keys.begin(), keys.end());
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    keymap[keys[i].first] = static_cast<VecKey>(i);
+  }
+
+  for (size_t i = 0; i < documents_.size(); i++) {
+    Vector *feature = documents_[i]->feature();
+    Vector pruned;
+    for (VecHashMap::const_iterator it = feature->hash_map()->begin();
+         it != feature->hash_map()->end(); ++it) {
+      HashMap<VecKey, VecKey>::type::const_iterator kit =
+        keymap.find(it->first);
+      if (kit != keymap.end()) pruned.set(kit->second, it->second);
+    }
+    *feature = pruned;
+  }
+  return df.size() - keys.size();
+}
+
 /**
  * Calculate inverse document frequency(IDF) and apply it to document vectors.
  */
@@ -189,6 +708,18 @@ void  Analyzer::idf() {
   }
 }
 
+/**
+ * Calculate inverse document frequency(IDF) with a sketch
+ * and apply it to document vectors.
+ */
+void Analyzer::idf(CountMinSketch &df) {
+  count_df(df);
+  size_t ndocs = documents_.size();
+  for (size_t i = 0; i < ndocs; i++) {
+    documents_[i]->idf(df, ndocs);
+  }
+}
+
 /**
  * Calculate standard socre and apply it to document vectors.
  */
@@ -219,18 +750,19 @@ void Analyzer::standard_score() {
  * Do k-means clustering.
  */
 size_t Analyzer::kmeans() {
-  Cluster *cluster = new Cluster;
+  Cluster *cluster = pool_.get();
   cluster->set_seed(seed_);
   for (size_t i = 0; i < documents_.size(); i++) {
     cluster->add_document(documents_[i]);
   }
   cluster->section(limit_nclusters_);
-  refine_clusters(cluster->sectioned_clusters());
+  if (reorder_flag_ && !projected_.empty()) reorder_documents(cluster);
+  refine_clusters(cluster->sectioned_clusters(), refine_loop_);
   for (size_t i = 0; i < cluster->sectioned_clusters().size(); i++) {
     cluster->sectioned_clusters()[i]->refresh();
     clusters_.push_back(cluster->sectioned_clusters()[i]);
   }
-  delete cluster;
+  pool_.release(cluster);
   return clusters_.size();
 }
 
@@ -238,9 +770,16 @@ size_t Analyzer::kmeans() {
  * Do clustering.
  */
 size_t Analyzer::do_clustering(Method method) {
+  project_documents();
+  document_slots_.clear();
+  for (size_t i = 0; i < documents_.size() && !projected_.empty(); i++) {
+    document_slots_[reinterpret_cast<size_t>(documents_[i])] = i;
+  }
   size_t num = 0;
   if      (method == KMEANS) num = kmeans();
   else if (method == RB) num = repeated_bisection();
+  std::vector<double>().swap(projected_);
+  document_slots_.clear();
   return num;
 }
 
@@ -44,16 +44,57 @@ class Analyzer {
     KMEANS  ///< kmeans
   };
 
- private:
-  /** maximum count of cluster refinement loop */
-  static const unsigned int NUM_REFINE_LOOP = 30;
+  /** default maximum count of cluster refinement loop */
+  static const unsigned int DEFAULT_REFINE_LOOP = 30;
+
+  /**
+   * Node of the cluster tree made by repeated bisection.
+   */
+  struct TreeNode {
+    Vector centroid;  ///< centroid vector of an internal node
+    long parent;      ///< the index of the parent node (-1: root)
+    long cluster;     ///< the index of a leaf in clusters() (-1: internal)
+    double gain;      ///< the gain of dividing an internal node
+  };
 
+ private:
   std::vector<Document *> documents_;  ///< documents
   std::vector<Cluster *> clusters_;    ///< clustering results
   size_t cluster_index_;               ///< the index of clusters
   size_t limit_nclusters_;             ///< maximum number of clusters
   double limit_eval_;                  ///< limit of sectioned points
   unsigned int seed_;                  ///< a seed of a random number generator
+  bool tree_flag_;                     ///< keep the cluster tree or not
+  std::vector<TreeNode> tree_;         ///< cluster tree
+  size_t projection_dim_;              ///< dimension of projected documents
+  std::vector<double> projected_;      ///< projected documents (row-major)
+  bool reorder_flag_;                  ///< reorder documents by clusters
+  size_t lazy_sample_size_;            ///< sample size of lazy bisection
+  size_t bisection_sample_size_;       ///< sample size of bisection
+  unsigned int sample_refine_loop_;    ///< refinement after sampled bisection
+  size_t thread_size_;                 ///< the number of threads
+  size_t branch_size_;                 ///< sectioned clusters of each cluster
+  unsigned int refine_loop_;           ///< maximum count of refinement loop
+  double refine_tolerance_;            ///< minimum relative gain of a loop
+  bool refine_active_set_;             ///< refine the active set or not
+  /**
+   * slots of documents in the vector container and the projected rows,
+   * keyed by the addresses of documents since their ids may be duplicated
+   */
+  HashMap<size_t, size_t>::type document_slots_;
+  ClusterPool pool_;                   ///< clusters of clustering results
+  /** scratch of documents in refinement */
+  std::vector<Document *> refine_documents_;
+  /** scratch of the cluster labels of documents in refinement */
+  std::vector<unsigned int> refine_labels_;
+  /** scratch of the projected rows of documents in refinement */
+  std::vector<const double *> refine_rows_;
+  /** scratch of projected composite vectors in refinement */
+  std::vector<double> refine_composites_;
+  /** scratch of the margins of documents from moves plus drifts */
+  std::vector<double> refine_bounds_;
+  /** scratch of the visiting order of documents in refinement */
+  std::vector<size_t> refine_order_;
 
   /**
    * Do repeated bisection clustering.
@@ -67,49 +108,113 @@ class Analyzer {
    */
   size_t kmeans();
 
+  /**
+   * Bisect a cluster (or divide it into more clusters)
+   * and set the gain of the bisection.
+   * @param cluster a cluster
+   * @param nclusters the number of sectioned clusters
+   */
+  void bisect(Cluster *cluster, size_t nclusters);
+
+  /**
+   * Section a cluster by sectioning sampled documents
+   * and assigning all documents to the nearest centroids of them.
+   * At least nclusters documents are sampled.
+   * @param cluster a cluster
+   * @param nclusters the number of sectioned clusters
+   * @return false if the sample is too small to be sectioned, in which
+   *         case the cluster is left unsectioned
+   */
+  bool section_by_sample(Cluster *cluster, size_t nclusters);
+
+  /**
+   * Estimate the gain of the bisection of a cluster by bisecting
+   * sampled documents, without sectioning the cluster.
+   * @param cluster a cluster
+   */
+  void estimate_sectioned_gain(Cluster *cluster);
+
   /**
    * Refine clustering results.
+   * After the first loop, only the active set of documents, which may
+   * have come close to other clusters, is checked. Each document keeps
+   * the margin of its best move, and the margin is reduced by drifts of
+   * composite vectors in later loops. A loop without moves in the
+   * active set is followed by a loop of all documents.
    * @param clusters clusters to be refined
+   * @param max_loop maximum count of refinement loop
    * @return the value of refiend clusters
    */
-  double refine_clusters(std::vector<Cluster *> &clusters);
+  double refine_clusters(std::vector<Cluster *> &clusters,
+                         unsigned int max_loop);
 
   inline double refined_vector_value(const Vector &composite,
                                      const Vector &vec, int sign);
 
+  inline double moved_norm(double norm, double value) const;
+
+  inline double projected_vector_value(const double *composite,
+                                       const double *vec, int sign) const;
+
   /**
-   * Count document frequency(DF) of the features in documents.
-   * @param df document frequency
+   * Project documents into dense vectors by a very sparse random
+   * projection (Achlioptas). Each key has the same number of nonzero
+   * elements of random signs, placed by its hash values.
    */
-  void count_df(HashMap<VecKey, size_t>::type &df) const;
+  void project_documents();
+
+  /**
+   * Get the slot of a document in the vector container.
+   * @param doc a document
+   * @return the slot of the document, which is also its projected row
+   */
+  size_t document_slot(const Document *doc) {
+    return document_slots_[reinterpret_cast<size_t>(doc)];
+  }
+
+  /**
+   * Reorder the documents of a cluster in the order of its sectioned
+   * clusters within the slots they occupy, and move their projected
+   * vectors into the same rows. Documents themselves are not copied.
+   * @param cluster a sectioned cluster
+   */
+  void reorder_documents(Cluster *cluster);
 
  public:
   /**
    * Constructor.
    */
   Analyzer() : cluster_index_(0), limit_nclusters_(0), limit_eval_(-1.0),
-               seed_(DEFAULT_SEED) { }
+               seed_(DEFAULT_SEED), tree_flag_(false), projection_dim_(0),
+               reorder_flag_(false), lazy_sample_size_(0),
+               bisection_sample_size_(0), sample_refine_loop_(1),
+               thread_size_(1), branch_size_(2),
+               refine_loop_(DEFAULT_REFINE_LOOP), refine_tolerance_(0.0),
+               refine_active_set_(false) {
+    init_hash_map(static_cast<size_t>(0), document_slots_);
+  }
 
  /**
   * Constructor.
   * @param seed seed for random number generator
   */
   explicit Analyzer(unsigned int seed)
-    : cluster_index_(0), limit_nclusters_(0), limit_eval_(-1.0), seed_(seed) { }
+    : cluster_index_(0), limit_nclusters_(0), limit_eval_(-1.0), seed_(seed),
+      tree_flag_(false), projection_dim_(0), reorder_flag_(false),
+      lazy_sample_size_(0), bisection_sample_size_(0), sample_refine_loop_(1),
+      thread_size_(1), branch_size_(2), refine_loop_(DEFAULT_REFINE_LOOP),
+      refine_tolerance_(0.0), refine_active_set_(false) {
+    init_hash_map(static_cast<size_t>(0), document_slots_);
+  }
 
  /**
   * Destructor.
   */
   ~Analyzer() {
+    // clusters are deleted by the pool
     for (size_t i = 0; i < documents_.size(); i++) {
       delete documents_[i];
     }
-    for (size_t i = 0; i < clusters_.size(); i++) {
-      for (size_t j = 0; j < clusters_[i]->sectioned_clusters().size(); j++) {
-        delete clusters_[i]->sectioned_clusters()[j];
-      }
-      delete clusters_[i];
-    }
   }
 
   /**
@@ -148,6 +253,21 @@ class Analyzer {
     }
   }
 
+  /**
+   * Remove the features whose document frequency is out of a range
+   * and renumber the remaining keys from zero in the order of keys,
+   * or in descending order of document frequency, which gives frequent
+   * keys small numbers.
+   * @param min_df the minimum document frequency
+   * @param max_df the maximum document frequency
+   * @param keymap output pairs of old keys and new keys
+   * @param df_order renumber keys in order of document frequency or not
+   * @return the number of removed keys
+   */
+  size_t prune_features(size_t min_df, size_t max_df,
+                        HashMap<VecKey, VecKey>::type &keymap,
+                        bool df_order = false);
+
   /**
    * Get clusters.
    * @return clusters
@@ -156,12 +276,32 @@ class Analyzer {
     return clusters_;
   }
 
+  /**
+   * Count document frequency(DF) of the features in documents.
+   * @param df document frequency
+   */
+  void count_df(HashMap<VecKey, size_t>::type &df) const;
+
+  /**
+   * Count document frequency(DF) of the features in documents
+   * into a sketch.
+   * @param df a sketch of document frequency
+   */
+  void count_df(CountMinSketch &df) const;
+
   /**
    * Calculate inverse document frequency(IDF)
    * and apply it to document vectors.
    */
   void idf();
 
+  /**
+   * Calculate inverse document frequency(IDF) with document frequency
+   * estimated by a sketch and apply it to document vectors.
+   * @param df an empty sketch of document frequency
+   */
+  void idf(CountMinSketch &df);
+
   /**
    * Calculate standard socre and apply it to document vectors.
    */
@@ -202,6 +342,123 @@ class Analyzer {
   void set_eval_limit(double limit) {
     limit_eval_ = limit;
   }
+
+  /**
+   * Keep the tree of clusters in repeated bisection.
+   * @param flag keep the tree or not
+   */
+  void set_tree_flag(bool flag) {
+    tree_flag_ = flag;
+  }
+
+  /**
+   * Set the dimension of a random projection of documents.
+   * In refinement, the target of each document is chosen with dense
+   * projected vectors and only the move to it is checked with sparse
+   * feature vectors, which trades missed moves for the speed.
+   * Results are kept in the original keys.
+   * @param dim the dimension of projected vectors (0: no projection)
+   */
+  void set_projection_dim(size_t dim) {
+    projection_dim_ = dim;
+  }
+
+  /**
+   * Reorder documents by clusters during clustering.
+   * Before a cluster is sectioned, its documents are reordered in the
+   * order of clusters (and of the tree in repeated bisection), so that
+   * each cluster is sectioned and refined over contiguous slots of
+   * documents() and of projected vectors. Documents themselves are not
+   * moved, so this has no effect without set_projection_dim.
+   * @param flag reorder documents or not
+   */
+  void set_reorder_flag(bool flag) {
+    reorder_flag_ = flag;
+  }
+
+  /**
+   * Bisect clusters lazily in repeated bisection.
+   * The gain of a cluster larger than a sample size is estimated by
+   * bisecting sampled documents, and the cluster is bisected only when
+   * it has the largest gain in the queue, which saves the bisections of
+   * clusters never divided. A bisected cluster returns to the queue, and
+   * is divided when its exact gain is the largest.
+   * @param size the number of sampled documents (0: bisect all clusters)
+   */
+  void set_lazy_sample_size(size_t size) {
+    lazy_sample_size_ = size;
+  }
+
+  /**
+   * Bisect large clusters with samples in repeated bisection.
+   * A cluster larger than a sample size is bisected by sampled documents,
+   * then all of its documents are assigned to the nearest centroids
+   * and refined in a few loops.
+   * @param size the number of sampled documents (0: no sampling)
+   * @param refine_loop maximum count of refinement loop of all documents
+   */
+  void set_bisection_sample_size(size_t size, unsigned int refine_loop = 1) {
+    bisection_sample_size_ = size;
+    sample_refine_loop_ = refine_loop;
+  }
+
+  /**
+   * Set the number of clusters into which each cluster is divided
+   * in repeated bisection. More branches make a shallower tree, in which
+   * documents are refined fewer times.
+   * @param size the number of branches (2: bisection)
+   */
+  void set_branch_size(size_t size) {
+    branch_size_ = size;
+  }
+
+  /**
+   * Set the maximum count of refinement loop.
+   * @param loop maximum count of refinement loop
+   */
+  void set_refine_loop(unsigned int loop) {
+    refine_loop_ = loop;
+  }
+
+  /**
+   * Set the tolerance of refinement. Refinement stops when the gain
+   * of a loop of all documents is less than the tolerance times the sum
+   * of the norms of composite vectors. A loop of the active set with
+   * such a gain is followed by a loop of all documents.
+   * @param tolerance relative gain (0: refine until no document moves)
+   */
+  void set_refine_tolerance(double tolerance) {
+    refine_tolerance_ = tolerance;
+  }
+
+  /**
+   * Refine clusters with the active set of documents.
+   * Documents are visited in the order of their storage instead of
+   * a shuffled order, and loops after the first check only documents
+   * near the boundaries of clusters, which is estimated by the drifts
+   * of composite vectors. This is faster but changes the results.
+   * @param flag refine the active set or not
+   */
+  void set_refine_active_set(bool flag) {
+    refine_active_set_ = flag;
+  }
+
+  /**
+   * Set the number of threads assigning documents to clusters.
+   * @param size the number of threads
+   */
+  void set_thread_size(size_t size) {
+    thread_size_ = size;
+  }
+
+  /**
+   * Get the cluster tree made by repeated bisection.
+   * Parents precede their children and the first node is the root.
+   * @return nodes of the cluster tree
+   */
+  const std::vector<TreeNode> &cluster_tree() const {
+    return tree_;
+  }
 };
 
 }  /* namespace bayon */
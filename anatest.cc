@@ -17,6 +17,7 @@
 // Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 //
 
+#include <algorithm>
 #include <ctime>
 #include <map>
 #include <vector>
@@ -56,6 +57,82 @@ void set_cluster(bayon::Cluster &cluster,
   }
 }
 
+void init_features(size_t ndocs, std::vector<bayon::Vector> &features) {
+  features.resize(ndocs);
+  for (size_t i = 0; i < ndocs; i++) {
+    for (size_t j = 0; j < NUM_FEATURE; j++) {
+      features[i].set(rand() % MAX_FEATURE_ID,
+                      static_cast<double>(rand()) / RAND_MAX * MAX_POINT);
+    }
+  }
+}
+
+void add_documents(const std::vector<bayon::Vector> &features,
+                   bayon::Analyzer &analyzer, size_t ndup = 1) {
+  // the analyzer takes the features of documents, and each ndup
+  // documents share an id
+  for (size_t i = 0; i < features.size(); i++) {
+    bayon::Document doc(i / ndup);
+    features[i].copy(*doc.feature());
+    analyzer.add_document(doc);
+  }
+}
+
+size_t get_results(bayon::Analyzer &analyzer,
+                   std::vector<std::vector<bayon::DocumentId> > &results) {
+  std::map<bayon::DocumentId, bool> choosed;
+  for (size_t i = 0; i < analyzer.clusters().size(); i++) {
+    const bayon::Cluster *cluster = analyzer.clusters()[i];
+    std::vector<bayon::DocumentId> ids;
+    for (size_t j = 0; j < cluster->documents().size(); j++) {
+      bayon::DocumentId id = cluster->documents()[j]->id();
+      EXPECT_TRUE(choosed.find(id) == choosed.end());
+      choosed[id] = true;
+      ids.push_back(id);
+    }
+    results.push_back(ids);
+  }
+  return choosed.size();
+}
+
+double sum_norms(const std::vector<bayon::Cluster *> &clusters) {
+  double sum = 0.0;
+  for (size_t i = 0; i < clusters.size(); i++) {
+    sum += clusters[i]->composite_vector()->norm();
+  }
+  return sum;
+}
+
+void expect_local_optimum(const std::vector<bayon::Cluster *> &clusters) {
+  // composite vectors of the documents, which leaves of repeated
+  // bisection do not keep
+  std::vector<bayon::Vector> composites(clusters.size());
+  for (size_t i = 0; i < clusters.size(); i++) {
+    for (size_t j = 0; j < clusters[i]->documents().size(); j++) {
+      composites[i].add_vector(*clusters[i]->documents()[j]->feature());
+    }
+  }
+  // no document moves to another cluster with a gain
+  for (size_t i = 0; i < clusters.size(); i++) {
+    double norm_base = composites[i].norm();
+    for (size_t j = 0; j < clusters[i]->documents().size(); j++) {
+      bayon::Vector *vec = clusters[i]->documents()[j]->feature();
+      bayon::Vector base;
+      composites[i].copy(base);
+      base.delete_vector(*vec);
+      for (size_t k = 0; k < clusters.size(); k++) {
+        if (k == i) continue;
+        bayon::Vector target;
+        composites[k].copy(target);
+        target.add_vector(*vec);
+        double gain = base.norm() + target.norm() - norm_base
+                      - composites[k].norm();
+        EXPECT_LE(gain, 1e-9);
+      }
+    }
+  }
+}
+
 }  /* namespace */
 
 /* Analyzer::idf */
@@ -95,6 +172,61 @@ TEST(AnalyzerTest, IdfTest) {
   delete_documents(documents);
 }
 
+/* Analyzer::prune_features */
+TEST(AnalyzerTest, PruneFeaturesTest) {
+  bayon::Analyzer analyzer;
+  for (size_t i = 0; i < NUM_DOCUMENT; i++) {
+    bayon::Document doc(i);
+    doc.add_feature(100, 1.0);                 // in all documents
+    doc.add_feature(200 + i, 2.0);             // in a document
+    doc.add_feature(300 + i % 2, 3.0);         // in half of documents
+    doc.add_feature(400 + i % 3, 4.0);         // in a third of documents
+    analyzer.add_document(doc);
+  }
+
+  bayon::HashMap<bayon::VecKey, bayon::VecKey>::type keymap;
+  bayon::init_hash_map(bayon::VECTOR_EMPTY_KEY, keymap);
+  size_t nremoved = analyzer.prune_features(2, NUM_DOCUMENT - 1, keymap);
+  EXPECT_EQ(nremoved, NUM_DOCUMENT + 1);
+  EXPECT_EQ(keymap.size(), 5U);
+  EXPECT_EQ(keymap[300], 0);
+  EXPECT_EQ(keymap[301], 1);
+  EXPECT_EQ(keymap[400], 2);
+  EXPECT_EQ(keymap[402], 4);
+
+  std::vector<bayon::Document *> &documents = analyzer.documents();
+  for (size_t i = 0; i < documents.size(); i++) {
+    const bayon::Vector *feature = documents[i]->feature();
+    EXPECT_EQ(feature->size(), 2U);
+    EXPECT_EQ(feature->get(i % 2), 3.0);
+    EXPECT_EQ(feature->get(2 + i % 3), 4.0);
+  }
+}
+
+/* Analyzer::prune_features in order of document frequency */
+TEST(AnalyzerTest, PruneFeaturesDfOrderTest) {
+  bayon::Analyzer analyzer;
+  for (size_t i = 0; i < NUM_DOCUMENT; i++) {
+    bayon::Document doc(i);
+    doc.add_feature(100 + i, 2.0);             // in a document
+    doc.add_feature(300 + i % 2, 3.0);         // in half of documents
+    doc.add_feature(400, 1.0);                 // in all documents
+    analyzer.add_document(doc);
+  }
+
+  bayon::HashMap<bayon::VecKey, bayon::VecKey>::type keymap;
+  bayon::init_hash_map(bayon::VECTOR_EMPTY_KEY, keymap);
+  size_t nremoved = analyzer.prune_features(0, NUM_DOCUMENT, keymap, true);
+  EXPECT_EQ(nremoved, 0U);
+  EXPECT_EQ(keymap.size(), NUM_DOCUMENT + 3);
+  EXPECT_EQ(keymap[400], 0);
+  EXPECT_EQ(keymap[301], 1);
+  EXPECT_EQ(keymap[300], 2);
+  EXPECT_EQ(keymap[100 + NUM_DOCUMENT - 1], 3);
+  EXPECT_EQ(keymap[100], static_cast<bayon::VecKey>(NUM_DOCUMENT + 2));
+  EXPECT_EQ(analyzer.documents()[0]->feature()->get(0), 1.0);
+}
+
 /* Analyzer::do_clustering(RB) */
 TEST(AnalyzerTest, DoClusteringRBTest) {
   std::vector<bayon::Document *> documents;
@@ -122,6 +254,177 @@ TEST(AnalyzerTest, DoClusteringRBTest) {
   delete_documents(documents);
 }
 
+/* Analyzer::cluster_tree */
+TEST(AnalyzerTest, ClusterTreeTest) {
+  std::vector<bayon::Document *> documents;
+  init_documents(documents);
+  bayon::Analyzer analyzer;
+
+  for (size_t i = 0; i < documents.size(); i++) {
+    analyzer.add_document(*documents[i]);
+  }
+  size_t nclusters = 4;
+  analyzer.set_cluster_size_limit(nclusters);
+  analyzer.set_tree_flag(true);
+  analyzer.do_clustering(bayon::Analyzer::RB);
+
+  const std::vector<bayon::Analyzer::TreeNode> &tree = analyzer.cluster_tree();
+  size_t nleaves = analyzer.clusters().size();
+  EXPECT_EQ(nleaves * 2 - 1, tree.size());
+  EXPECT_EQ(-1, tree[0].parent);
+  std::map<long, size_t> nchildren, leaves;
+  for (size_t i = 0; i < tree.size(); i++) {
+    if (i > 0) {
+      EXPECT_TRUE(0 <= tree[i].parent && tree[i].parent < static_cast<long>(i));
+      nchildren[tree[i].parent]++;
+    }
+    if (tree[i].cluster >= 0) {
+      EXPECT_TRUE(tree[i].cluster < static_cast<long>(nleaves));
+      leaves[tree[i].cluster]++;
+    } else {
+      EXPECT_NEAR(1.0, tree[i].centroid.norm(), 1e-9);
+    }
+  }
+  EXPECT_EQ(nleaves, leaves.size());
+  for (std::map<long, size_t>::iterator it = nchildren.begin();
+       it != nchildren.end(); ++it) {
+    EXPECT_EQ(static_cast<size_t>(2), it->second);
+    EXPECT_EQ(-1, tree[it->first].cluster);
+  }
+  delete_documents(documents);
+}
+
+/* Analyzer::do_clustering(RB) with more branches */
+TEST(AnalyzerTest, BranchTest) {
+  std::vector<bayon::Vector> features;
+  init_features(50, features);
+  bayon::Analyzer analyzer;
+  add_documents(features, analyzer);
+  size_t nclusters = 6;
+  analyzer.set_cluster_size_limit(nclusters);
+  analyzer.set_branch_size(4);
+  analyzer.set_tree_flag(true);
+  // refine sectioned clusters until no document moves
+  analyzer.set_refine_loop(1000);
+  EXPECT_EQ(nclusters, analyzer.do_clustering(bayon::Analyzer::RB));
+  std::vector<std::vector<bayon::DocumentId> > results;
+  EXPECT_EQ(features.size(), get_results(analyzer, results));
+
+  // 1 -> 4 -> 6 (the last cluster is divided into three)
+  const std::vector<bayon::Analyzer::TreeNode> &tree = analyzer.cluster_tree();
+  ASSERT_EQ(nclusters + 2, tree.size());
+  std::map<long, std::vector<bayon::Cluster *> > children;
+  std::map<long, size_t> nchildren;
+  for (size_t i = 1; i < tree.size(); i++) {
+    nchildren[tree[i].parent]++;
+    if (tree[i].cluster < 0) continue;
+    children[tree[i].parent].push_back(analyzer.clusters()[tree[i].cluster]);
+  }
+  ASSERT_EQ(static_cast<size_t>(2), nchildren.size());
+  EXPECT_EQ(static_cast<size_t>(4), nchildren[0]);
+  long last = nchildren.rbegin()->first;
+  EXPECT_EQ(static_cast<size_t>(3), nchildren[last]);
+
+  // the three clusters are refined together
+  ASSERT_EQ(static_cast<size_t>(3), children[last].size());
+  expect_local_optimum(children[last]);
+
+  // the gain of the last division is that of the three clusters
+  bayon::Vector parent;
+  double gain = 0.0;
+  for (size_t i = 0; i < children[last].size(); i++) {
+    bayon::Vector composite;
+    for (size_t j = 0; j < children[last][i]->documents().size(); j++) {
+      composite.add_vector(*children[last][i]->documents()[j]->feature());
+    }
+    gain += composite.norm();
+    parent.add_vector(composite);
+  }
+  gain -= parent.norm();
+  EXPECT_NEAR(gain, tree[last].gain, 1e-9);
+
+  // clusters smaller than the branch size are divided as well
+  std::vector<bayon::Vector> few;
+  init_features(6, few);
+  bayon::Analyzer small;
+  add_documents(few, small);
+  small.set_cluster_size_limit(3);
+  small.set_branch_size(8);
+  EXPECT_EQ(static_cast<size_t>(3), small.do_clustering(bayon::Analyzer::RB));
+  std::vector<std::vector<bayon::DocumentId> > small_results;
+  EXPECT_EQ(few.size(), get_results(small, small_results));
+}
+
+/* Analyzer::set_refine_loop, Analyzer::set_refine_tolerance */
+TEST(AnalyzerTest, RefineLoopTest) {
+  std::vector<bayon::Vector> features;
+  init_features(200, features);
+  std::vector<std::vector<bayon::DocumentId> > results[4];
+  double norms[4];
+  for (size_t run = 0; run < 4; run++) {
+    bayon::Analyzer analyzer(1);
+    add_documents(features, analyzer);
+    analyzer.set_cluster_size_limit(4);
+    // refine until no document moves
+    if (run == 0) analyzer.set_refine_loop(1000);
+    if (run == 1) analyzer.set_refine_loop(1);
+    // the gain of a loop is always less than the sum of norms
+    if (run == 2) analyzer.set_refine_tolerance(1.0);
+    if (run == 3) {
+      analyzer.set_refine_loop(1000);
+      analyzer.set_refine_tolerance(0.001);
+    }
+    analyzer.do_clustering(bayon::Analyzer::KMEANS);
+    EXPECT_EQ(features.size(), get_results(analyzer, results[run]));
+    norms[run] = sum_norms(analyzer.clusters());
+    if (run == 0) expect_local_optimum(analyzer.clusters());
+  }
+  // every run begins with the same loop of all documents, and a tolerance
+  // stops after a loop of all documents with a small gain
+  EXPECT_EQ(results[1], results[2]);
+  EXPECT_GE(norms[0] + 1e-9, norms[1]);
+  EXPECT_GE(norms[3] + 1e-9, norms[1]);
+}
+
+/* Analyzer::do_clustering refines clusters with labels of documents */
+TEST(AnalyzerTest, RefineTest) {
+  std::vector<bayon::Vector> features;
+  init_features(200, features);
+  std::vector<std::vector<bayon::DocumentId> > results[2];
+  double norms[2];
+  for (size_t refine = 0; refine < 2; refine++) {
+    bayon::Analyzer analyzer(1);
+    add_documents(features, analyzer);
+    analyzer.set_cluster_size_limit(4);
+    // refine until no document moves
+    analyzer.set_refine_loop(refine == 0 ? 0 : 1000);
+    analyzer.do_clustering(bayon::Analyzer::KMEANS);
+    EXPECT_EQ(features.size(), get_results(analyzer, results[refine]));
+    norms[refine] = sum_norms(analyzer.clusters());
+    if (refine > 0) expect_local_optimum(analyzer.clusters());
+  }
+  // refinement moves documents from the clusters of the initial section
+  EXPECT_TRUE(results[0] != results[1]);
+  EXPECT_GT(norms[1], norms[0]);
+}
+
+/* Analyzer::set_refine_active_set */
+TEST(AnalyzerTest, RefineActiveSetTest) {
+  std::vector<bayon::Vector> features;
+  init_features(200, features);
+  std::vector<std::vector<bayon::DocumentId> > results;
+  bayon::Analyzer analyzer(1);
+  add_documents(features, analyzer);
+  analyzer.set_cluster_size_limit(4);
+  analyzer.set_refine_active_set(true);
+  // refine until no document moves
+  analyzer.set_refine_loop(1000);
+  analyzer.do_clustering(bayon::Analyzer::KMEANS);
+  EXPECT_EQ(features.size(), get_results(analyzer, results));
+  // the last loop checks all documents again
+  expect_local_optimum(analyzer.clusters());
+}
+
 /* Analyzer::do_clustering(k-means) */
 TEST(AnalyzerTest, DoClusteringKmeansTest) {
   std::vector<bayon::Document *> documents;
@@ -149,6 +452,173 @@ TEST(AnalyzerTest, DoClusteringKmeansTest) {
   delete_documents(documents);
 }
 
+/* Analyzer::do_clustering with random projection */
+TEST(AnalyzerTest, ProjectionTest) {
+  // two groups of documents with disjoint keys, which share a key in
+  // each group so that projected vectors do not miss moves between them
+  bayon::Analyzer analyzer;
+  size_t ndocs = 20;
+  for (size_t i = 0; i < ndocs; i++) {
+    bayon::Document doc(i);
+    bayon::VecKey offset = (i % 2 == 0) ? 0 : 100;
+    for (size_t j = 0; j < NUM_FEATURE; j++) {
+      doc.add_feature(offset + rand() % MAX_FEATURE_ID,
+                      1.0 + static_cast<double>(rand()) / RAND_MAX);
+    }
+    doc.add_feature(offset + MAX_FEATURE_ID, MAX_POINT);
+    analyzer.add_document(doc);
+  }
+  analyzer.set_cluster_size_limit(2);
+  analyzer.set_projection_dim(16);
+  analyzer.do_clustering(bayon::Analyzer::RB);
+
+  size_t count = 0;
+  bayon::Cluster cluster;
+  while (analyzer.get_next_result(cluster)) {
+    ASSERT_GT(cluster.size(), 0U);
+    bayon::DocumentId first = cluster.documents()[0]->id();
+    for (size_t i = 0; i < cluster.size(); i++) {
+      EXPECT_EQ(first % 2, cluster.documents()[i]->id() % 2);
+    }
+    count += cluster.size();
+  }
+  EXPECT_EQ(ndocs, count);
+}
+
+/* Analyzer::do_clustering with lazy bisection */
+TEST(AnalyzerTest, LazyBisectionTest) {
+  // groups of identical documents, which samples estimate well
+  size_t ngroups = 6;
+  std::vector<std::vector<bayon::DocumentId> > results[2];
+  std::vector<long> parents[2];
+  for (size_t lazy = 0; lazy < 2; lazy++) {
+    bayon::Analyzer analyzer;
+    bayon::DocumentId id = 0;
+    for (size_t i = 0; i < ngroups; i++) {
+      for (size_t j = 0; j < 8 + i * 2; j++) {
+        bayon::Document doc(id++);
+        doc.add_feature(i + 1, 1.0);
+        analyzer.add_document(doc);
+      }
+    }
+    analyzer.set_eval_limit(1.0);
+    analyzer.set_lazy_sample_size(lazy > 0 ? 4 : 0);
+    analyzer.set_tree_flag(true);
+    EXPECT_EQ(ngroups, analyzer.do_clustering(bayon::Analyzer::RB));
+    EXPECT_EQ(static_cast<size_t>(id), get_results(analyzer, results[lazy]));
+    std::sort(results[lazy].begin(), results[lazy].end());
+    EXPECT_EQ(ngroups * 2 - 1, analyzer.cluster_tree().size());
+    for (size_t i = 0; i < analyzer.cluster_tree().size(); i++) {
+      parents[lazy].push_back(analyzer.cluster_tree()[i].parent);
+    }
+  }
+  // clusters are divided in the same order and stop at the same limit
+  EXPECT_EQ(parents[0], parents[1]);
+  EXPECT_EQ(results[0], results[1]);
+}
+
+/* Analyzer::do_clustering with sampled bisection */
+TEST(AnalyzerTest, SampleBisectionTest) {
+  std::vector<bayon::Vector> features;
+  init_features(50, features);
+  size_t nclusters = 5;
+  std::vector<std::vector<bayon::DocumentId> > results[2];
+  for (size_t k = 0; k < 2; k++) {
+    bayon::Analyzer analyzer;
+    add_documents(features, analyzer);
+    analyzer.set_cluster_size_limit(nclusters);
+    analyzer.set_bisection_sample_size(10);
+    analyzer.set_thread_size(k == 0 ? 1 : 3);
+    EXPECT_EQ(nclusters, analyzer.do_clustering(bayon::Analyzer::RB));
+    EXPECT_EQ(features.size(), get_results(analyzer, results[k]));
+  }
+  // threads assign documents to the same centroids
+  EXPECT_EQ(results[0], results[1]);
+
+  // all documents assigned by a sample are refined afterwards
+  bayon::Analyzer analyzer;
+  add_documents(features, analyzer);
+  analyzer.set_cluster_size_limit(2);
+  analyzer.set_bisection_sample_size(10, 1000);
+  analyzer.set_thread_size(3);
+  analyzer.do_clustering(bayon::Analyzer::RB);
+  expect_local_optimum(analyzer.clusters());
+
+  // samples smaller than the branch size are enlarged
+  for (size_t size = 1; size < 4; size++) {
+    bayon::Analyzer small;
+    add_documents(features, small);
+    small.set_cluster_size_limit(nclusters);
+    small.set_branch_size(4);
+    small.set_bisection_sample_size(size);
+    EXPECT_EQ(nclusters, small.do_clustering(bayon::Analyzer::RB));
+    std::vector<std::vector<bayon::DocumentId> > small_results;
+    EXPECT_EQ(features.size(), get_results(small, small_results));
+  }
+}
+
+/* Analyzer::do_clustering with reordered documents */
+TEST(AnalyzerTest, ReorderTest) {
+  std::vector<bayon::Vector> features;
+  init_features(50, features);
+  for (int method = bayon::Analyzer::RB; method <= bayon::Analyzer::KMEANS;
+       method++) {
+    // documents of duplicated ids are reordered as well
+    for (size_t ndup = 1; ndup <= 2; ndup++) {
+      std::vector<std::vector<size_t> > results[2];
+      for (size_t reorder = 0; reorder < 2; reorder++) {
+        bayon::Analyzer analyzer;
+        add_documents(features, analyzer, ndup);
+        std::map<const bayon::Document *, size_t> positions;
+        for (size_t i = 0; i < analyzer.documents().size(); i++) {
+          positions[analyzer.documents()[i]] = i;
+        }
+        analyzer.set_cluster_size_limit(5);
+        analyzer.set_projection_dim(8);
+        analyzer.set_reorder_flag(reorder > 0);
+        // k-means refines clusters after reordering them
+        if (method == bayon::Analyzer::KMEANS) analyzer.set_refine_loop(0);
+        analyzer.do_clustering(static_cast<bayon::Analyzer::Method>(method));
+
+        // documents are permuted, not copied
+        std::vector<bayon::Document *> &documents = analyzer.documents();
+        std::map<const bayon::Document *, size_t> slots;
+        for (size_t i = 0; i < documents.size(); i++) {
+          EXPECT_TRUE(positions.find(documents[i]) != positions.end());
+          slots[documents[i]] = i;
+        }
+        EXPECT_EQ(positions.size(), slots.size());
+
+        // each cluster occupies contiguous slots in its order
+        for (size_t i = 0; i < analyzer.clusters().size(); i++) {
+          const bayon::Cluster *cluster = analyzer.clusters()[i];
+          ASSERT_LT(static_cast<size_t>(0), cluster->documents().size());
+          size_t begin = slots[cluster->documents()[0]];
+          std::vector<size_t> members;
+          for (size_t j = 0; j < cluster->documents().size(); j++) {
+            const bayon::Document *doc = cluster->documents()[j];
+            if (reorder > 0) {
+              EXPECT_EQ(begin + j, slots[doc]);
+            }
+            members.push_back(positions[doc]);
+          }
+          results[reorder].push_back(members);
+        }
+      }
+      EXPECT_EQ(results[0], results[1]);
+    }
+  }
+
+  // documents are not reordered without projected vectors
+  bayon::Analyzer analyzer;
+  add_documents(features, analyzer);
+  std::vector<bayon::Document *> documents = analyzer.documents();
+  analyzer.set_cluster_size_limit(5);
+  analyzer.set_reorder_flag(true);
+  analyzer.do_clustering(bayon::Analyzer::RB);
+  EXPECT_TRUE(documents == analyzer.documents());
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   int result = RUN_ALL_TESTS();
@@ -18,11 +18,14 @@
 //
 
 #include <getopt.h>
+#include <pthread.h>
 #include <cstdio>
 #include <cstdlib>
 #include <ctime>
 #include <fstream>
+#include <iostream>
 #include <map>
+#include <queue>
 #include <string>
 #include <utility>
 #include <vector>
@@ -36,15 +39,46 @@ typedef enum {
   OPT_LIMIT    = 'l',
   OPT_POINT    = 'p',
   OPT_CLVECTOR = 'c',
-  OPT_CLVECTOR_SIZE,
+  OPT_CLVECTOR_SIZE = 256,  // options without short names are over 255
+  OPT_CLTREE,
   OPT_METHOD,
   OPT_SEED,
   OPT_CLASSIFY = 'C',
-  OPT_INV_KEYS,
+  OPT_INV_KEYS = OPT_SEED + 1,
   OPT_INV_SIZE,
   OPT_CLASSIFY_SIZE,
+  OPT_CLASSIFY_METHOD,
+  OPT_CLASSIFY_TREE,
+  OPT_BEAM,
+  OPT_RESCORE_SIZE,
+  OPT_HNSW_M,
+  OPT_HNSW_EF,
+  OPT_HNSW_EF_CONSTRUCTION,
+  OPT_HNSW_SAVE,
+  OPT_HNSW_LOAD,
+  OPT_CACHE_SIZE,
+  OPT_FROZEN_VOCAB,
+  OPT_THREAD,
+  OPT_MIN_DF,
+  OPT_MAX_DF,
+  OPT_DF_ORDER,
+  OPT_PROJECTION,
+  OPT_REORDER,
+  OPT_LAZY_SAMPLE,
+  OPT_BISECTION_SAMPLE,
+  OPT_SAMPLE_REFINE,
+  OPT_BRANCH,
+  OPT_REFINE_LOOP,
+  OPT_REFINE_TOLERANCE,
+  OPT_REFINE_ACTIVE,
   OPT_VECTOR_SIZE,
   OPT_IDF,
+  OPT_DF_SAVE,
+  OPT_DF_LOAD,
+  OPT_DF_SKETCH,
+  OPT_DF_HEAVY,
+  OPT_HASH_FEATURES,
+  OPT_HASH_SIGN,
   OPT_HELP     = 'h',
   OPT_VERSION  = 'v',
 } bayon_options;
@@ -54,6 +88,43 @@ typedef bayon::HashMap<std::string, double>::type Feature;
 typedef bayon::HashMap<bayon::DocumentId, std::string>::type DocId2Str;
 typedef bayon::HashMap<bayon::VecKey, std::string>::type VecKey2Str;
 typedef bayon::HashMap<std::string, bayon::VecKey>::type Str2VecKey;
+typedef bayon::HashMap<bayon::VecKey, size_t>::type DocFreq;
+typedef bayon::HashMap<bayon::VecKey, bayon::VecKey>::type KeyMap;
+typedef bayon::HashMap<bayon::VecKey, bayon::VecValue>::type KeySign;
+
+/* settings of classification */
+struct ClassifyConfig {
+  const bayon::Classifier *classifier;  // classifier
+  const DocId2Str *claid2str;           // names of classifier vectors
+  const DocFreq *df;                    // document frequency (NULL: no idf)
+  const bayon::CountMinSketch *df_sketch;  // estimated document frequency
+  size_t ndocs;                         // the number of documents for idf
+  size_t vector_size;                   // max size of vectors (0: all)
+  size_t max_keys;                      // max size of looked up keys
+  size_t max_output;                    // max size of output
+};
+
+/* a document in classification pipeline */
+struct ClassifyJob {
+  bayon::Document *doc;  // input document
+  std::string name;      // document name
+  std::string result;    // output string
+  bool done;             // true if classified
+};
+
+/* pipeline of multi-threaded classification */
+struct ClassifyPipeline {
+  const ClassifyConfig *config;    // settings of classification
+  std::vector<ClassifyJob> jobs;   // ring buffer of jobs
+  std::queue<size_t> queue;        // jobs waiting for workers
+  size_t nread;                    // the number of read documents
+  size_t nwritten;                 // the number of written documents
+  bool eof;                        // true if all documents are read
+  pthread_mutex_t mutex;           // lock of this pipeline
+  pthread_cond_t cond_job;         // signaled when a job is queued
+  pthread_cond_t cond_result;      // signaled when a job is classified
+  pthread_cond_t cond_slot;        // signaled when a job is written
+};
 
 
 /********************************************************************
@@ -64,8 +135,12 @@ const size_t DEFAULT_MAX_CLVECTOR    = 50;
 const size_t DEFAULT_MAX_CLASSIFY    = 20;
 const size_t DEFAULT_MAX_INDEX_KEY   = 20;
 const size_t DEFAULT_MAX_INDEX       = 100;
+const size_t PIPELINE_JOBS_PER_THREAD = 256;
 const bayon::VecKey VEC_START_KEY    = 0;
 const bayon::DocumentId DOC_START_ID = 0;
+const std::string TREE_NODE_PREFIX("_");
+const std::string TREE_ROOT_PARENT("-");
+const std::string STDIN_FILENAME("-");
 
 
 /********************************************************************
@@ -77,14 +152,46 @@ struct option longopts[] = {
   {"point",         no_argument,       NULL, OPT_POINT        },
   {"clvector",      required_argument, NULL, OPT_CLVECTOR     },
   {"clvector-size", required_argument, NULL, OPT_CLVECTOR_SIZE},
+  {"cltree",        required_argument, NULL, OPT_CLTREE       },
   {"method",        required_argument, NULL, OPT_METHOD       },
   {"seed",          required_argument, NULL, OPT_SEED         },
+  {"min-df",        required_argument, NULL, OPT_MIN_DF       },
+  {"max-df",        required_argument, NULL, OPT_MAX_DF       },
+  {"df-order",      no_argument,       NULL, OPT_DF_ORDER     },
+  {"projection",    required_argument, NULL, OPT_PROJECTION   },
+  {"reorder",       no_argument,       NULL, OPT_REORDER      },
+  {"lazy-sample",   required_argument, NULL, OPT_LAZY_SAMPLE  },
+  {"bisection-sample", required_argument, NULL, OPT_BISECTION_SAMPLE},
+  {"sample-refine", required_argument, NULL, OPT_SAMPLE_REFINE},
+  {"branch",        required_argument, NULL, OPT_BRANCH       },
+  {"refine-loop",   required_argument, NULL, OPT_REFINE_LOOP  },
+  {"refine-tolerance", required_argument, NULL, OPT_REFINE_TOLERANCE},
+  {"refine-active", no_argument,       NULL, OPT_REFINE_ACTIVE},
   {"classify",      required_argument, NULL, OPT_CLASSIFY     },
   {"inv-keys",      required_argument, NULL, OPT_INV_KEYS     },
   {"inv-size",      required_argument, NULL, OPT_INV_SIZE     },
   {"classify-size", required_argument, NULL, OPT_CLASSIFY_SIZE},
+  {"classify-method", required_argument, NULL, OPT_CLASSIFY_METHOD},
+  {"classify-tree", required_argument, NULL, OPT_CLASSIFY_TREE},
+  {"beam",          required_argument, NULL, OPT_BEAM         },
+  {"rescore-size",  required_argument, NULL, OPT_RESCORE_SIZE },
+  {"hnsw-m",        required_argument, NULL, OPT_HNSW_M       },
+  {"hnsw-ef",       required_argument, NULL, OPT_HNSW_EF      },
+  {"hnsw-ef-construction", required_argument, NULL,
+   OPT_HNSW_EF_CONSTRUCTION},
+  {"hnsw-save",     required_argument, NULL, OPT_HNSW_SAVE    },
+  {"hnsw-load",     required_argument, NULL, OPT_HNSW_LOAD    },
+  {"cache-size",    required_argument, NULL, OPT_CACHE_SIZE   },
+  {"frozen-vocab",  no_argument,       NULL, OPT_FROZEN_VOCAB },
+  {"thread",        required_argument, NULL, OPT_THREAD       },
   {"vector-size",   required_argument, NULL, OPT_VECTOR_SIZE  },
   {"idf",           no_argument,       NULL, OPT_IDF          },
+  {"df-save",       required_argument, NULL, OPT_DF_SAVE      },
+  {"df-load",       required_argument, NULL, OPT_DF_LOAD      },
+  {"df-sketch",     required_argument, NULL, OPT_DF_SKETCH    },
+  {"df-heavy",      required_argument, NULL, OPT_DF_HEAVY     },
+  {"hash-features", required_argument, NULL, OPT_HASH_FEATURES},
+  {"hash-sign",     no_argument,       NULL, OPT_HASH_SIGN    },
   {"help",          no_argument,       NULL, OPT_HELP         },
   {"version",       no_argument,       NULL, OPT_VERSION      },
   {0, 0, 0, 0}
@@ -101,28 +208,98 @@ static size_t parse_tsv(std::string &tsv, Feature &feature);
 static void read_document(std::string &str, bayon::Document &doc,
                           bayon::VecKey &veckey, DocId2Str &docid2str,
                           VecKey2Str &veckey2str, Str2VecKey &str2veckey);
-static size_t read_documents(std::ifstream &ifs, bayon::Analyzer &analyzer,
+static void read_known_document(const std::string &str, bayon::Document &doc,
+                                const bayon::Vocabulary *vocab,
+                                const bayon::FeatureHasher *hasher,
+                                DocId2Str &docid2str);
+static size_t count_document_frequency(std::istream &is,
+                                       const bayon::Vocabulary *vocab,
+                                       const bayon::FeatureHasher *hasher,
+                                       bayon::VecKey &veckey,
+                                       DocId2Str &docid2str,
+                                       VecKey2Str &veckey2str,
+                                       Str2VecKey &str2veckey, DocFreq &df,
+                                       bayon::CountMinSketch *df_sketch);
+static size_t read_documents(std::istream &is, bayon::Analyzer &analyzer,
+                             const bayon::FeatureHasher *hasher,
                              bayon::VecKey &veckey, DocId2Str &docid2str,
                              VecKey2Str &veckey2str, Str2VecKey &str2veckey);
+static void save_document_frequency(std::ofstream &ofs, const DocFreq &df,
+                                    size_t ndocs,
+                                    const VecKey2Str &veckey2str);
+static bool read_document_frequency(std::ifstream &ifs,
+                                    const bayon::Vocabulary *vocab,
+                                    const bayon::FeatureHasher *hasher,
+                                    bayon::VecKey &veckey,
+                                    VecKey2Str &veckey2str,
+                                    Str2VecKey &str2veckey,
+                                    DocFreq &df,
+                                    bayon::CountMinSketch *df_sketch,
+                                    size_t &ndocs);
+static bool prepare_document_frequency(const Option &option, std::istream &is,
+                                       const bayon::Vocabulary *vocab,
+                                       const bayon::FeatureHasher *hasher,
+                                       bayon::VecKey &veckey,
+                                       DocId2Str &docid2str,
+                                       VecKey2Str &veckey2str,
+                                       Str2VecKey &str2veckey,
+                                       DocFreq &df,
+                                       bayon::CountMinSketch *df_sketch,
+                                       size_t &ndocs);
 static size_t read_classifier_vectors(size_t max_index,
                                       std::ifstream &ifs,
                                       bayon::Classifier &classifier,
+                                      const bayon::FeatureHasher *hasher,
                                       bayon::VecKey &veckey,
                                       DocId2Str &claid2str,
                                       VecKey2Str &veckey2str,
                                       Str2VecKey &str2veckey);
+static bool read_classifier_tree(std::ifstream &ifs,
+                                 bayon::Classifier &classifier,
+                                 const bayon::FeatureHasher *hasher,
+                                 bayon::VecKey &veckey,
+                                 const DocId2Str &claid2str,
+                                 VecKey2Str &veckey2str,
+                                 Str2VecKey &str2veckey);
 static void show_clusters(const std::vector<bayon::Cluster *> &clusters,
                           DocId2Str &docid2str, bool show_point);
-static void show_classified(size_t max_keys, size_t max_output,
-                            const bayon::Classifier &classifer,
-                            const bayon::Document &document,
-                            const DocId2Str &docid2str,
-                            const DocId2Str &claid2str);
+static void classify_document(const ClassifyConfig &config,
+                              bayon::Document &document,
+                              const std::string &doc_name,
+                              std::string &result);
+static void *classify_worker(void *arg);
+static void *classify_writer(void *arg);
+static bool classify_documents(const ClassifyConfig &config,
+                               size_t nthreads, const bayon::Vocabulary *vocab,
+                               const bayon::FeatureHasher *hasher,
+                               std::istream &is,
+                               bayon::VecKey &veckey, DocId2Str &docid2str,
+                               VecKey2Str &veckey2str,
+                               Str2VecKey &str2veckey);
 static void save_cluster_vector(size_t max_vec, std::ofstream &ofs,
                                 const std::vector<bayon::Cluster *> &clusters,
-                                const VecKey2Str &veckey2str);
-static int execute_clustering(const Option &option, std::ifstream &ifs_doc);
-static int execute_classification(const Option &option, std::ifstream &ifs_doc);
+                                const VecKey2Str &veckey2str,
+                                const KeySign &signs);
+static void save_cluster_tree(size_t max_vec, std::ofstream &ofs,
+                              bayon::Analyzer &analyzer,
+                              const VecKey2Str &veckey2str,
+                              const KeySign &signs);
+static size_t parse_df_limit(const std::string &str, size_t ndocs,
+                             bool upper);
+static void prune_features(size_t min_df, size_t max_df,
+                           bayon::Analyzer &analyzer, bayon::VecKey &veckey,
+                           VecKey2Str &veckey2str, Str2VecKey &str2veckey,
+                           KeyMap &keymap, bool df_order);
+static bool parse_hash_bits(const Option &option, size_t &bits);
+static void restore_key_names(std::istream &is,
+                              const bayon::FeatureHasher &hasher,
+                              const KeyMap *keymap,
+                              const std::vector<const bayon::Vector *>
+                                &vectors,
+                              size_t max_vec, VecKey2Str &veckey2str,
+                              KeySign &signs);
+static int execute_clustering(const Option &option, std::istream &is_doc);
+static int execute_classification(const Option &option, std::istream &is_doc);
 static void version();
 
 
@@ -147,17 +324,21 @@ int main(int argc, char **argv) {
     usage(progname);
     return EXIT_FAILURE;
   }
-  std::ifstream ifs_doc(argv[0]);
-  if (!ifs_doc) {
-    fprintf(stderr, "[ERROR]File not found: %s\n", argv[0]);
-    return EXIT_FAILURE;
+  std::ifstream ifs_doc;
+  if (argv[0] != STDIN_FILENAME) {
+    ifs_doc.open(argv[0]);
+    if (!ifs_doc) {
+      fprintf(stderr, "[ERROR]File not found: %s\n", argv[0]);
+      return EXIT_FAILURE;
+    }
   }
+  std::istream &is_doc = (argv[0] != STDIN_FILENAME) ? ifs_doc : std::cin;
   if (option.find(OPT_CLASSIFY) != option.end()) {
     /* classification */
-    return execute_classification(option, ifs_doc);
+    return execute_classification(option, is_doc);
   } else {
     /* clustering */
-    return execute_clustering(option, ifs_doc);
+    return execute_clustering(option, is_doc);
   }
 }
 
@@ -175,8 +356,39 @@ static void usage(std::string progname) {
   fprintf(stderr, "    --clvector-size=num   max size of output vectors of\n");
   fprintf(stderr, "                          cluster centroids (default: %zd)\n",
           DEFAULT_MAX_CLVECTOR);
+  fprintf(stderr, "    --cltree=file         save the tree of cluster centroids (rb)\n");
   fprintf(stderr, "    --method=method       clustering method(rb, kmeans), default:rb\n");
-  fprintf(stderr, "    --seed=seed           set a seed for random number generator\n\n");
+  fprintf(stderr, "    --seed=seed           set a seed for random number generator\n");
+  fprintf(stderr, "    --min-df=num          remove the keys of less document frequency\n");
+  fprintf(stderr, "                          (a ratio to documents if num has a point)\n");
+  fprintf(stderr, "    --max-df=num          remove the keys of more document frequency\n");
+  fprintf(stderr, "                          (a ratio to documents if num has a point)\n");
+  fprintf(stderr, "    --df-order            renumber keys in descending order of document\n");
+  fprintf(stderr, "                          frequency\n");
+  fprintf(stderr, "    --projection=dim      refine clusters with dense vectors of random\n");
+  fprintf(stderr, "                          projection of the dimension (default: 0)\n");
+  fprintf(stderr, "    --reorder             reorder projected vectors in the order of\n");
+  fprintf(stderr, "                          clusters (needs --projection)\n");
+  fprintf(stderr, "    --lazy-sample=num     estimate gains of bisection with samples of\n");
+  fprintf(stderr, "                          num documents and bisect clusters when they\n");
+  fprintf(stderr, "                          are chosen (rb, default: 0, no estimation)\n");
+  fprintf(stderr, "    --bisection-sample=num\n");
+  fprintf(stderr, "                          bisect clusters of more than num documents\n");
+  fprintf(stderr, "                          with samples of num documents and assign\n");
+  fprintf(stderr, "                          all documents to them (rb, default: 0)\n");
+  fprintf(stderr, "    --sample-refine=num   max count of refinement loop of all documents\n");
+  fprintf(stderr, "                          after --bisection-sample (default: 1)\n");
+  fprintf(stderr, "    --branch=num          the number of clusters into which each\n");
+  fprintf(stderr, "                          cluster is divided (rb, default: 2)\n");
+  fprintf(stderr, "    --refine-loop=num     max count of refinement loop (default: %u)\n",
+          bayon::Analyzer::DEFAULT_REFINE_LOOP);
+  fprintf(stderr, "    --refine-tolerance=num\n");
+  fprintf(stderr, "                          stop refinement when the gain of a loop is\n");
+  fprintf(stderr, "                          less than num times the sum of the norms of\n");
+  fprintf(stderr, "                          clusters (default: 0, until no move)\n");
+  fprintf(stderr, "    --refine-active       refine documents in the order of storage and\n");
+  fprintf(stderr, "                          only those near the boundaries of clusters\n");
+  fprintf(stderr, "                          after the first loop (faster, results differ)\n\n");
   fprintf(stderr, "* Get the similar clusters for each input documents\n");
   fprintf(stderr, " %% %s -C file [options] file\n", progname.c_str());
   fprintf(stderr, "    -C, --classify=file   target vectors\n");
@@ -186,12 +398,50 @@ static void usage(std::string progname) {
   fprintf(stderr, "    --inv-size=num        max size of the inverted index of each key\n");
   fprintf(stderr, "                          (default: %zd)\n", DEFAULT_MAX_INDEX);
   fprintf(stderr, "    --classify-size=num   max size of output similar groups\n");
-  fprintf(stderr, "                          (default: %zd)\n\n", DEFAULT_MAX_CLASSIFY);
+  fprintf(stderr, "                          (default: %zd)\n", DEFAULT_MAX_CLASSIFY);
+  fprintf(stderr, "    --classify-method=method\n");
+  fprintf(stderr, "                          scoring method(exact, accum, maxscore,\n");
+  fprintf(stderr, "                          dense, hnsw, tree), default:exact\n");
+  fprintf(stderr, "    --classify-tree=file  cluster tree for tree method\n");
+  fprintf(stderr, "    --beam=num            beam size of tree method (default: %zd)\n",
+          bayon::Classifier::DEFAULT_BEAM_SIZE);
+  fprintf(stderr, "    --rescore-size=num    max size of candidates rescored exactly\n");
+  fprintf(stderr, "                          in accum method (default: 0, no rescoring)\n");
+  fprintf(stderr, "    --hnsw-m=num          max size of links of each node in hnsw\n");
+  fprintf(stderr, "                          method (default: %zd)\n",
+          bayon::HnswIndex::DEFAULT_MAX_LINKS);
+  fprintf(stderr, "    --hnsw-ef=num         size of search candidates in hnsw method\n");
+  fprintf(stderr, "                          (default: %zd)\n",
+          bayon::HnswIndex::DEFAULT_EF);
+  fprintf(stderr, "    --hnsw-ef-construction=num\n");
+  fprintf(stderr, "                          size of candidates in the construction\n");
+  fprintf(stderr, "                          of hnsw graph (default: %zd)\n",
+          bayon::HnswIndex::DEFAULT_EF_CONSTRUCTION);
+  fprintf(stderr, "    --hnsw-save=file      save the graph of hnsw method\n");
+  fprintf(stderr, "    --hnsw-load=file      load the graph of hnsw method\n");
+  fprintf(stderr, "    --cache-size=num      memory size(MB) of the cache of similar\n");
+  fprintf(stderr, "                          groups (default: 0, no cache)\n");
+  fprintf(stderr, "    --frozen-vocab        ignore the keys of input documents which\n");
+  fprintf(stderr, "                          are not in target vectors\n\n");
   fprintf(stderr, "* Common options\n");
   fprintf(stderr, "    --vector-size=num     max size of each input vector\n");
   fprintf(stderr, "    --idf                 apply idf to input vectors\n");
+  fprintf(stderr, "    --df-save=file        save document frequency of input documents\n");
+  fprintf(stderr, "    --df-load=file        apply idf with document frequency saved by\n");
+  fprintf(stderr, "                          --df-save (classification only)\n");
+  fprintf(stderr, "    --df-sketch=num       estimate document frequency for idf in the\n");
+  fprintf(stderr, "                          memory size(MB) of count-min sketch\n");
+  fprintf(stderr, "    --df-heavy=num        max size of the most frequent keys counted\n");
+  fprintf(stderr, "                          exactly with --df-sketch (default: 0)\n");
+  fprintf(stderr, "    --hash-features=bits  use hash values of the bits as keys\n");
+  fprintf(stderr, "                          instead of the dictionary of keys\n");
+  fprintf(stderr, "    --hash-sign           add hashed keys with random signs\n");
+  fprintf(stderr, "    --thread=num          the number of threads of classification and\n");
+  fprintf(stderr, "                          --bisection-sample (default: 1)\n");
   fprintf(stderr, "    -h, --help            show help messages\n");
   fprintf(stderr, "    -v, --version         show the version and exit\n");
+  fprintf(stderr, "  (the input file \"%s\" means standard input)\n",
+          STDIN_FILENAME.c_str());
 }
 
 /* parse command line options */
@@ -217,12 +467,51 @@ static int parse_options(int argc, char **argv, Option &option) {
     case OPT_CLVECTOR_SIZE:
       option[OPT_CLVECTOR_SIZE] = optarg;
       break;
+    case OPT_CLTREE:
+      option[OPT_CLTREE] = optarg;
+      break;
     case OPT_METHOD:
       option[OPT_METHOD] = optarg;
       break;
     case OPT_SEED:
       option[OPT_SEED] = optarg;
       break;
+    case OPT_MIN_DF:
+      option[OPT_MIN_DF] = optarg;
+      break;
+    case OPT_MAX_DF:
+      option[OPT_MAX_DF] = optarg;
+      break;
+    case OPT_DF_ORDER:
+      option[OPT_DF_ORDER] = DUMMY_OPTARG;
+      break;
+    case OPT_PROJECTION:
+      option[OPT_PROJECTION] = optarg;
+      break;
+    case OPT_REORDER:
+      option[OPT_REORDER] = DUMMY_OPTARG;
+      break;
+    case OPT_LAZY_SAMPLE:
+      option[OPT_LAZY_SAMPLE] = optarg;
+      break;
+    case OPT_BISECTION_SAMPLE:
+      option[OPT_BISECTION_SAMPLE] = optarg;
+      break;
+    case OPT_SAMPLE_REFINE:
+      option[OPT_SAMPLE_REFINE] = optarg;
+      break;
+    case OPT_BRANCH:
+      option[OPT_BRANCH] = optarg;
+      break;
+    case OPT_REFINE_LOOP:
+      option[OPT_REFINE_LOOP] = optarg;
+      break;
+    case OPT_REFINE_TOLERANCE:
+      option[OPT_REFINE_TOLERANCE] = optarg;
+      break;
+    case OPT_REFINE_ACTIVE:
+      option[OPT_REFINE_ACTIVE] = DUMMY_OPTARG;
+      break;
     case OPT_CLASSIFY:
       option[OPT_CLASSIFY] = optarg;
       break;
@@ -235,12 +524,66 @@ static int parse_options(int argc, char **argv, Option &option) {
     case OPT_CLASSIFY_SIZE:
       option[OPT_CLASSIFY_SIZE] = optarg;
       break;
+    case OPT_CLASSIFY_METHOD:
+      option[OPT_CLASSIFY_METHOD] = optarg;
+      break;
+    case OPT_CLASSIFY_TREE:
+      option[OPT_CLASSIFY_TREE] = optarg;
+      break;
+    case OPT_BEAM:
+      option[OPT_BEAM] = optarg;
+      break;
+    case OPT_RESCORE_SIZE:
+      option[OPT_RESCORE_SIZE] = optarg;
+      break;
+    case OPT_HNSW_M:
+      option[OPT_HNSW_M] = optarg;
+      break;
+    case OPT_HNSW_EF:
+      option[OPT_HNSW_EF] = optarg;
+      break;
+    case OPT_HNSW_EF_CONSTRUCTION:
+      option[OPT_HNSW_EF_CONSTRUCTION] = optarg;
+      break;
+    case OPT_HNSW_SAVE:
+      option[OPT_HNSW_SAVE] = optarg;
+      break;
+    case OPT_HNSW_LOAD:
+      option[OPT_HNSW_LOAD] = optarg;
+      break;
+    case OPT_CACHE_SIZE:
+      option[OPT_CACHE_SIZE] = optarg;
+      break;
+    case OPT_FROZEN_VOCAB:
+      option[OPT_FROZEN_VOCAB] = DUMMY_OPTARG;
+      break;
+    case OPT_THREAD:
+      option[OPT_THREAD] = optarg;
+      break;
     case OPT_VECTOR_SIZE:
       option[OPT_VECTOR_SIZE] = optarg;
       break;
     case OPT_IDF:
       option[OPT_IDF] = DUMMY_OPTARG;
       break;
+    case OPT_DF_SAVE:
+      option[OPT_DF_SAVE] = optarg;
+      break;
+    case OPT_DF_LOAD:
+      option[OPT_DF_LOAD] = optarg;
+      break;
+    case OPT_DF_SKETCH:
+      option[OPT_DF_SKETCH] = optarg;
+      break;
+    case OPT_DF_HEAVY:
+      option[OPT_DF_HEAVY] = optarg;
+      break;
+    case OPT_HASH_FEATURES:
+      option[OPT_HASH_FEATURES] = optarg;
+      break;
+    case OPT_HASH_SIGN:
+      option[OPT_HASH_SIGN] = DUMMY_OPTARG;
+      break;
     case OPT_HELP:
       option[OPT_HELP] = DUMMY_OPTARG;
       break;
@@ -303,16 +646,97 @@ static void read_document(std::string &str, bayon::Document &doc,
   }
 }
 
+/*
+ * parse input string with a fixed vocabulary (unknown keys are ignored)
+ * or with hashed keys (values of colliding keys are added)
+ */
+static void read_known_document(const std::string &str, bayon::Document &doc,
+                                const bayon::Vocabulary *vocab,
+                                const bayon::FeatureHasher *hasher,
+                                DocId2Str &docid2str) {
+  size_t p = str.find(bayon::DELIMITER);
+  docid2str[doc.id()].assign(str, 0, p);
+  if (p == str.npos) return;
+
+  const char *s = str.c_str();
+  const size_t delimiter_size = bayon::DELIMITER.size();
+  p += delimiter_size;
+  while (true) {
+    size_t q = str.find(bayon::DELIMITER, p);
+    size_t len = (q == str.npos ? str.size() : q) - p;
+    bayon::VecKey key = 0;
+    bayon::VecValue sign = 1.0;
+    bool known = false;
+    if (len > 0) {
+      if (hasher) {
+        key = hasher->find(s + p, len, sign);
+        known = true;
+      } else {
+        known = vocab->find(s + p, len, key);
+      }
+    }
+    if (q == str.npos) break;
+    p = q + delimiter_size;
+    q = str.find(bayon::DELIMITER, p);
+    if (known && q != p && p < str.size()) {
+      double point = atof(s + p);
+      if (point != 0) {
+        if (hasher) point = doc.feature()->get(key) + sign * point;
+        doc.add_feature(key, point);
+      }
+    }
+    if (q == str.npos) break;
+    p = q + delimiter_size;
+  }
+}
+
+/* count document frequency of input documents and rewind the input */
+static size_t count_document_frequency(std::istream &is,
+                                       const bayon::Vocabulary *vocab,
+                                       const bayon::FeatureHasher *hasher,
+                                       bayon::VecKey &veckey,
+                                       DocId2Str &docid2str,
+                                       VecKey2Str &veckey2str,
+                                       Str2VecKey &str2veckey, DocFreq &df,
+                                       bayon::CountMinSketch *df_sketch) {
+  size_t ndocs = 0;
+  std::string line;
+  while (std::getline(is, line)) {
+    bayon::Document doc(DOC_START_ID);
+    if (vocab || hasher) {
+      read_known_document(line, doc, vocab, hasher, docid2str);
+    } else {
+      read_document(line, doc, veckey, docid2str, veckey2str, str2veckey);
+    }
+    bayon::VecHashMap *hmap = doc.feature()->hash_map();
+    for (bayon::VecHashMap::iterator it = hmap->begin();
+      it != hmap->end(); ++it) {
+      if (df_sketch)                           df_sketch->add(it->first);
+      else if (df.find(it->first) == df.end()) df[it->first] = 1;
+      else                                     df[it->first]++;
+    }
+    ndocs++;
+  }
+  is.clear();
+  is.seekg(0, std::ios_base::beg);
+  return ndocs;
+}
+
 /* read input file and add documents to analyzer */
-static size_t read_documents(std::ifstream &ifs, bayon::Analyzer &analyzer,
+static size_t read_documents(std::istream &is, bayon::Analyzer &analyzer,
+                             const bayon::FeatureHasher *hasher,
                              bayon::VecKey &veckey, DocId2Str &docid2str,
                              VecKey2Str &veckey2str, Str2VecKey &str2veckey) {
   bayon::DocumentId docid = DOC_START_ID;
   std::string line;
-  while (std::getline(ifs, line)) {
+  while (std::getline(is, line)) {
     if (!line.empty()) {
       bayon::Document doc(docid);
-      read_document(line, doc, veckey, docid2str, veckey2str, str2veckey);
+      if (hasher) {
+        read_known_document(line, doc, NULL, hasher, docid2str);
+      } else {
+        read_document(line, doc, veckey, docid2str, veckey2str, str2veckey);
+      }
       analyzer.add_document(doc);
       docid++;
     }
@@ -320,10 +744,124 @@ static size_t read_documents(std::ifstream &ifs, bayon::Analyzer &analyzer,
   return docid;
 }
 
+/* save document frequency and the number of documents */
+static void save_document_frequency(std::ofstream &ofs, const DocFreq &df,
+                                    size_t ndocs,
+                                    const VecKey2Str &veckey2str) {
+  ofs << ndocs << std::endl;
+  for (DocFreq::const_iterator it = df.begin(); it != df.end(); ++it) {
+    VecKey2Str::const_iterator itv = veckey2str.find(it->first);
+    if (itv == veckey2str.end()) continue;
+    ofs << itv->second << bayon::DELIMITER << it->second << std::endl;
+  }
+}
+
+/* read document frequency saved by save_document_frequency */
+static bool read_document_frequency(std::ifstream &ifs,
+                                    const bayon::Vocabulary *vocab,
+                                    const bayon::FeatureHasher *hasher,
+                                    bayon::VecKey &veckey,
+                                    VecKey2Str &veckey2str,
+                                    Str2VecKey &str2veckey,
+                                    DocFreq &df,
+                                    bayon::CountMinSketch *df_sketch,
+                                    size_t &ndocs) {
+  std::string line;
+  if (!std::getline(ifs, line)) return false;
+  ndocs = strtoul(line.c_str(), NULL, 10);
+  if (ndocs == 0) return false;
+  while (std::getline(ifs, line)) {
+    size_t p = line.rfind(bayon::DELIMITER);
+    if (p == line.npos || p == 0) return false;
+    size_t count = strtoul(line.c_str() + p + bayon::DELIMITER.size(),
+                           NULL, 10);
+    if (count == 0) return false;
+    line.resize(p);
+    bayon::VecKey key;
+    bayon::VecValue sign;
+    if (hasher) {
+      // colliding keys share the counts
+      key = hasher->find(line, sign);
+      if (!df_sketch && df.find(key) != df.end()) count += df[key];
+    } else if (vocab) {
+      if (!vocab->find(line, key)) continue;
+    } else {
+      Str2VecKey::const_iterator it = str2veckey.find(line);
+      if (it != str2veckey.end()) {
+        key = it->second;
+      } else {
+        key = veckey++;
+        str2veckey[line] = key;
+        veckey2str[key] = line;
+      }
+    }
+    if (df_sketch) df_sketch->add(key, count);
+    else           df[key] = count;
+  }
+  return true;
+}
+
+/* load or count document frequency for classification */
+static bool prepare_document_frequency(const Option &option, std::istream &is,
+                                       const bayon::Vocabulary *vocab,
+                                       const bayon::FeatureHasher *hasher,
+                                       bayon::VecKey &veckey,
+                                       DocId2Str &docid2str,
+                                       VecKey2Str &veckey2str,
+                                       Str2VecKey &str2veckey,
+                                       DocFreq &df,
+                                       bayon::CountMinSketch *df_sketch,
+                                       size_t &ndocs) {
+  Option::const_iterator oit;
+  if ((oit = option.find(OPT_DF_LOAD)) != option.end()) {
+    std::ifstream ifs_df(oit->second.c_str());
+    if (!ifs_df) {
+      fprintf(stderr, "[ERROR]File not found: %s\n", oit->second.c_str());
+      return false;
+    }
+    if (!read_document_frequency(ifs_df, vocab, hasher, veckey, veckey2str,
+                                 str2veckey, df, df_sketch, ndocs)) {
+      fprintf(stderr, "[ERROR]Illegal document frequency: %s\n",
+              oit->second.c_str());
+      return false;
+    }
+  } else if (option.find(OPT_IDF) != option.end()
+             || option.find(OPT_DF_SAVE) != option.end()) {
+    // input documents are read twice
+    if (&is == &std::cin) {
+      fprintf(stderr, "[ERROR]Standard input needs saved document frequency: ");
+      fprintf(stderr, "--df-load\n");
+      return false;
+    }
+    ndocs = count_document_frequency(is, vocab, hasher, veckey, docid2str,
+                                     veckey2str, str2veckey, df, df_sketch);
+  }
+  if ((oit = option.find(OPT_DF_SAVE)) != option.end()) {
+    if (df_sketch) {
+      fprintf(stderr, "[ERROR]Estimated document frequency cannot be saved: ");
+      fprintf(stderr, "--df-save\n");
+      return false;
+    }
+    if (hasher) {
+      fprintf(stderr, "[ERROR]Hashed keys cannot be saved: ");
+      fprintf(stderr, "--df-save\n");
+      return false;
+    }
+    std::ofstream ofs(oit->second.c_str());
+    if (!ofs) {
+      fprintf(stderr, "[ERROR]Cannot open file: %s\n", oit->second.c_str());
+      return false;
+    }
+    save_document_frequency(ofs, df, ndocs, veckey2str);
+  }
+  return true;
+}
+
 /* read input file and add vectors to classifier */
 static size_t read_classifier_vectors(size_t max_index,
                                       std::ifstream &ifs,
                                       bayon::Classifier &classifier,
+                                      const bayon::FeatureHasher *hasher,
                                       bayon::VecKey &veckey,
                                       DocId2Str &claid2str,
                                       VecKey2Str &veckey2str,
@@ -341,6 +879,12 @@ static size_t read_classifier_vectors(size_t max_index,
       parse_tsv(line, feature);
       bayon::Vector vec;
       for (Feature::iterator it = feature.begin(); it != feature.end(); ++it) {
+        if (hasher) {
+          bayon::VecValue sign;
+          bayon::VecKey key = hasher->find(it->first, sign);
+          vec.set(key, vec.get(key) + sign * it->second);
+          continue;
+        }
         if (str2veckey.find(it->first) == str2veckey.end()) {
           str2veckey[it->first] = veckey;
           veckey2str[veckey] = it->first;
@@ -356,6 +900,72 @@ static size_t read_classifier_vectors(size_t max_index,
   return 0;
 }
 
+/* read a cluster tree and add it to classifier */
+static bool read_classifier_tree(std::ifstream &ifs,
+                                 bayon::Classifier &classifier,
+                                 const bayon::FeatureHasher *hasher,
+                                 bayon::VecKey &veckey,
+                                 const DocId2Str &claid2str,
+                                 VecKey2Str &veckey2str,
+                                 Str2VecKey &str2veckey) {
+  typedef bayon::HashMap<std::string, bayon::Classifier::VectorId>::type
+    Str2ClaId;
+  Str2ClaId leaves, nodes;
+  bayon::init_hash_map("", leaves);
+  bayon::init_hash_map("", nodes);
+  for (DocId2Str::const_iterator it = claid2str.begin();
+       it != claid2str.end(); ++it) {
+    leaves[it->second] = it->first;
+  }
+  bayon::Classifier::VectorId nodeid = claid2str.size();
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.empty()) continue;
+    size_t p = line.find(bayon::DELIMITER);
+    if (p == std::string::npos) return false;
+    std::string name = line.substr(0, p);
+    line = line.substr(p + bayon::DELIMITER.size());
+    p = line.find(bayon::DELIMITER);
+    std::string parent_name = line.substr(0, p);
+    line = (p == std::string::npos) ? "" :
+      line.substr(p + bayon::DELIMITER.size());
+
+    bayon::Classifier::VectorId parent = -1;
+    if (parent_name != TREE_ROOT_PARENT) {
+      Str2ClaId::iterator itp = nodes.find(parent_name);
+      if (itp == nodes.end()) return false;
+      parent = itp->second;
+    }
+    Str2ClaId::iterator itl = leaves.find(name);
+    if (itl != leaves.end()) {
+      classifier.add_tree_leaf(itl->second, parent);
+      continue;
+    }
+    Feature feature;
+    bayon::init_hash_map("", feature);
+    parse_tsv(line, feature);
+    bayon::Vector vec;
+    for (Feature::iterator it = feature.begin(); it != feature.end(); ++it) {
+      if (hasher) {
+        bayon::VecValue sign;
+        bayon::VecKey key = hasher->find(it->first, sign);
+        vec.set(key, vec.get(key) + sign * it->second);
+        continue;
+      }
+      if (str2veckey.find(it->first) == str2veckey.end()) {
+        str2veckey[it->first] = veckey;
+        veckey2str[veckey] = it->first;
+        veckey++;
+      }
+      vec.set(str2veckey[it->first], it->second);
+    }
+    nodes[name] = nodeid;
+    classifier.add_tree_node(nodeid, parent, vec);
+    nodeid++;
+  }
+  return true;
+}
+
 /* show clustering result */
 static void show_clusters(const std::vector<bayon::Cluster *> &clusters,
                           DocId2Str &docid2str, bool show_point) {
@@ -376,38 +986,194 @@ static void show_clusters(const std::vector<bayon::Cluster *> &clusters,
   }
 }
 
-/* show classified result */
-static void show_classified(size_t max_keys, size_t max_output,
-                            const bayon::Classifier &classifier,
-                            const bayon::Document &document,
-                            const DocId2Str &docid2str,
-                            const DocId2Str &claid2str) {
+/* weight a document and make a classified result string */
+static void classify_document(const ClassifyConfig &config,
+                              bayon::Document &document,
+                              const std::string &doc_name,
+                              std::string &result) {
+  if (config.df_sketch) document.idf(*config.df_sketch, config.ndocs);
+  else if (config.df)   document.idf(*config.df, config.ndocs);
+  if (config.vector_size > 0) document.feature()->resize(config.vector_size);
+  document.feature()->normalize();
+
   std::vector<std::pair<bayon::Classifier::VectorId, double> > pairs;
-  classifier.similar_vectors(max_keys, *document.feature(), pairs);
+  config.classifier->similar_vectors(config.max_keys, *document.feature(),
+                                     pairs);
 
-  DocId2Str::const_iterator it = docid2str.find(document.id());
-  if (it != docid2str.end()) {
-    printf("%s", it->second.c_str());
-  } else {
-    printf("%ld", document.id());
+  char buf[64];
+  result = doc_name;
+  for (size_t j = 0; j < pairs.size() && j < config.max_output; j++) {
+    DocId2Str::const_iterator it = config.claid2str->find(pairs[j].first);
+    result += bayon::DELIMITER;
+    if (it != config.claid2str->end()) {
+      result += it->second;
+    } else {
+      snprintf(buf, sizeof(buf), "%ld", pairs[j].first);
+      result += buf;
+    }
+    snprintf(buf, sizeof(buf), "%f", pairs[j].second);
+    result += bayon::DELIMITER + buf;
+  }
+  result += "\n";
+}
+
+/* worker thread of classification pipeline */
+static void *classify_worker(void *arg) {
+  ClassifyPipeline *pipeline = static_cast<ClassifyPipeline *>(arg);
+  while (true) {
+    pthread_mutex_lock(&pipeline->mutex);
+    while (pipeline->queue.empty() && !pipeline->eof) {
+      pthread_cond_wait(&pipeline->cond_job, &pipeline->mutex);
+    }
+    if (pipeline->queue.empty()) {
+      pthread_mutex_unlock(&pipeline->mutex);
+      break;
+    }
+    size_t seq = pipeline->queue.front();
+    pipeline->queue.pop();
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    ClassifyJob &job = pipeline->jobs[seq % pipeline->jobs.size()];
+    classify_document(*pipeline->config, *job.doc, job.name, job.result);
+
+    pthread_mutex_lock(&pipeline->mutex);
+    job.done = true;
+    pthread_cond_signal(&pipeline->cond_result);
+    pthread_mutex_unlock(&pipeline->mutex);
+  }
+  return NULL;
+}
+
+/* writer thread of classification pipeline (keeps input order) */
+static void *classify_writer(void *arg) {
+  ClassifyPipeline *pipeline = static_cast<ClassifyPipeline *>(arg);
+  std::string result;
+  while (true) {
+    pthread_mutex_lock(&pipeline->mutex);
+    while (!(pipeline->eof && pipeline->nwritten == pipeline->nread)
+           && !(pipeline->nwritten < pipeline->nread
+                && pipeline->jobs[pipeline->nwritten
+                                  % pipeline->jobs.size()].done)) {
+      pthread_cond_wait(&pipeline->cond_result, &pipeline->mutex);
+    }
+    if (pipeline->nwritten == pipeline->nread) {
+      pthread_mutex_unlock(&pipeline->mutex);
+      break;
+    }
+    ClassifyJob &job = pipeline->jobs[pipeline->nwritten
+                                      % pipeline->jobs.size()];
+    result.swap(job.result);
+    delete job.doc;
+    job.doc = NULL;
+    job.done = false;
+    pipeline->nwritten++;
+    pthread_cond_signal(&pipeline->cond_slot);
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    fputs(result.c_str(), stdout);
+  }
+  return NULL;
+}
+
+/* read input documents and output classified results
+   (returns false if threads cannot be created) */
+static bool classify_documents(const ClassifyConfig &config,
+                               size_t nthreads, const bayon::Vocabulary *vocab,
+                               const bayon::FeatureHasher *hasher,
+                               std::istream &is,
+                               bayon::VecKey &veckey, DocId2Str &docid2str,
+                               VecKey2Str &veckey2str,
+                               Str2VecKey &str2veckey) {
+  bayon::DocumentId docid = DOC_START_ID;
+  std::string line, result;
+  if (nthreads <= 1) {
+    while (std::getline(is, line)) {
+      bayon::Document doc(docid);
+      if (vocab || hasher) {
+        read_known_document(line, doc, vocab, hasher, docid2str);
+      } else {
+        read_document(line, doc, veckey, docid2str, veckey2str, str2veckey);
+      }
+      classify_document(config, doc, docid2str[docid], result);
+      fputs(result.c_str(), stdout);
+    }
+    return true;
   }
-  for (size_t j = 0; j < pairs.size() && j < max_output; j++) {
-    DocId2Str::const_iterator it = claid2str.find(pairs[j].first);
-    printf("%s", bayon::DELIMITER.c_str());
-    if (it != claid2str.end()) {
-      printf("%s", it->second.c_str());
+
+  ClassifyPipeline pipeline;
+  pipeline.config = &config;
+  ClassifyJob empty_job;
+  empty_job.doc = NULL;
+  empty_job.done = false;
+  pipeline.jobs.resize(nthreads * PIPELINE_JOBS_PER_THREAD, empty_job);
+  pipeline.nread = 0;
+  pipeline.nwritten = 0;
+  pipeline.eof = false;
+  pthread_mutex_init(&pipeline.mutex, NULL);
+  pthread_cond_init(&pipeline.cond_job, NULL);
+  pthread_cond_init(&pipeline.cond_result, NULL);
+  pthread_cond_init(&pipeline.cond_slot, NULL);
+
+  std::vector<pthread_t> workers(nthreads);
+  pthread_t writer;
+  size_t nworkers = 0;
+  while (nworkers < workers.size()
+         && pthread_create(&workers[nworkers], NULL,
+                           classify_worker, &pipeline) == 0) {
+    nworkers++;
+  }
+  bool started = nworkers == workers.size()
+                 && pthread_create(&writer, NULL,
+                                   classify_writer, &pipeline) == 0;
+  if (!started) workers.resize(nworkers);
+
+  while (started && std::getline(is, line)) {
+    pthread_mutex_lock(&pipeline.mutex);
+    while (pipeline.nread - pipeline.nwritten >= pipeline.jobs.size()) {
+      pthread_cond_wait(&pipeline.cond_slot, &pipeline.mutex);
+    }
+    size_t seq = pipeline.nread;
+    pthread_mutex_unlock(&pipeline.mutex);
+
+    // the slot is not used by other threads until it is queued
+    ClassifyJob &job = pipeline.jobs[seq % pipeline.jobs.size()];
+    job.doc = new bayon::Document(docid);
+    if (vocab || hasher) {
+      read_known_document(line, *job.doc, vocab, hasher, docid2str);
     } else {
-      printf("%ld", pairs[j].first);
+      read_document(line, *job.doc, veckey, docid2str, veckey2str, str2veckey);
     }
-    printf("%s%f", bayon::DELIMITER.c_str(), pairs[j].second);
+    job.name = docid2str[docid];
+
+    pthread_mutex_lock(&pipeline.mutex);
+    pipeline.queue.push(seq);
+    pipeline.nread++;
+    pthread_cond_signal(&pipeline.cond_job);
+    pthread_mutex_unlock(&pipeline.mutex);
   }
-  printf("\n");
+
+  pthread_mutex_lock(&pipeline.mutex);
+  pipeline.eof = true;
+  pthread_cond_broadcast(&pipeline.cond_job);
+  pthread_cond_broadcast(&pipeline.cond_result);
+  pthread_mutex_unlock(&pipeline.mutex);
+  for (size_t i = 0; i < workers.size(); i++) {
+    pthread_join(workers[i], NULL);
+  }
+  if (started) pthread_join(writer, NULL);
+
+  pthread_mutex_destroy(&pipeline.mutex);
+  pthread_cond_destroy(&pipeline.cond_job);
+  pthread_cond_destroy(&pipeline.cond_result);
+  pthread_cond_destroy(&pipeline.cond_slot);
+  return started;
 }
 
 /* save vectors of cluster centroids */
 static void save_cluster_vector(size_t max_vec, std::ofstream &ofs,
                                 const std::vector<bayon::Cluster *> &clusters,
-                                const VecKey2Str &veckey2str) {
+                                const VecKey2Str &veckey2str,
+                                const KeySign &signs) {
   size_t cluster_count = 1;
   for (size_t i = 0; i < clusters.size(); i++) {
     if (clusters[i]->size() > 0) {
@@ -419,14 +1185,155 @@ static void save_cluster_vector(size_t max_vec, std::ofstream &ofs,
         VecKey2Str::const_iterator itv = veckey2str.find(items[i].first);
         if (itv != veckey2str.end()) ofs << itv->second;
         else                         ofs << items[i].first;
-        ofs << bayon::DELIMITER << items[i].second;
+        KeySign::const_iterator its = signs.find(items[i].first);
+        ofs << bayon::DELIMITER
+            << (its != signs.end() ? its->second : 1.0) * items[i].second;
       }
       ofs << std::endl;
     }
   }
 }
 
-static int execute_clustering(const Option &option, std::ifstream &ifs_doc) {
+/* save the tree of cluster centroids */
+static void save_cluster_tree(size_t max_vec, std::ofstream &ofs,
+                              bayon::Analyzer &analyzer,
+                              const VecKey2Str &veckey2str,
+                              const KeySign &signs) {
+  const std::vector<bayon::Analyzer::TreeNode> &tree = analyzer.cluster_tree();
+  const std::vector<bayon::Cluster *> &clusters = analyzer.clusters();
+  // leaves have the same names as save_cluster_vector
+  std::vector<size_t> numbers(clusters.size(), 0);
+  size_t cluster_count = 1;
+  for (size_t i = 0; i < clusters.size(); i++) {
+    if (clusters[i]->size() > 0) numbers[i] = cluster_count++;
+  }
+  for (size_t i = 0; i < tree.size(); i++) {
+    if (tree[i].cluster >= 0) {
+      if (numbers[tree[i].cluster] == 0) continue;
+      ofs << numbers[tree[i].cluster];
+    } else {
+      ofs << TREE_NODE_PREFIX << i;
+    }
+    ofs << bayon::DELIMITER;
+    if (tree[i].parent < 0) ofs << TREE_ROOT_PARENT;
+    else                    ofs << TREE_NODE_PREFIX << tree[i].parent;
+    if (tree[i].cluster < 0) {
+      std::vector<bayon::VecItem> items;
+      tree[i].centroid.sorted_items_abs(items);
+      for (size_t j = 0; j < items.size() && j < max_vec; j++) {
+        ofs << bayon::DELIMITER;
+        VecKey2Str::const_iterator itv = veckey2str.find(items[j].first);
+        if (itv != veckey2str.end()) ofs << itv->second;
+        else                         ofs << items[j].first;
+        KeySign::const_iterator its = signs.find(items[j].first);
+        ofs << bayon::DELIMITER
+            << (its != signs.end() ? its->second : 1.0) * items[j].second;
+      }
+    }
+    ofs << std::endl;
+  }
+}
+
+/* parse the limit of document frequency (a ratio if it has a point) */
+static size_t parse_df_limit(const std::string &str, size_t ndocs,
+                             bool upper) {
+  if (str.find('.') == str.npos) return strtoul(str.c_str(), NULL, 10);
+  double limit = atof(str.c_str()) * ndocs;
+  return static_cast<size_t>(upper ? floor(limit) : ceil(limit));
+}
+
+/* remove keys by document frequency and renumber the others */
+static void prune_features(size_t min_df, size_t max_df,
+                           bayon::Analyzer &analyzer, bayon::VecKey &veckey,
+                           VecKey2Str &veckey2str, Str2VecKey &str2veckey,
+                           KeyMap &keymap, bool df_order) {
+  analyzer.prune_features(min_df, max_df, keymap, df_order);
+
+  VecKey2Str pruned;
+  bayon::init_hash_map(bayon::VECTOR_EMPTY_KEY, pruned);
+  Str2VecKey renumbered;
+  bayon::init_hash_map("", renumbered);
+  for (KeyMap::iterator it = keymap.begin(); it != keymap.end(); ++it) {
+    VecKey2Str::const_iterator itv = veckey2str.find(it->first);
+    if (itv == veckey2str.end()) continue;  // hashed key
+    pruned[VEC_START_KEY + it->second] = itv->second;
+    renumbered[itv->second] = VEC_START_KEY + it->second;
+  }
+  veckey2str.swap(pruned);
+  str2veckey.swap(renumbered);
+  veckey = VEC_START_KEY + keymap.size();
+}
+
+/* parse the bits of hashed keys (0: no hashing) */
+static bool parse_hash_bits(const Option &option, size_t &bits) {
+  Option::const_iterator oit = option.find(OPT_HASH_FEATURES);
+  bits = 0;
+  if (oit == option.end()) return true;
+  bits = strtoul(oit->second.c_str(), NULL, 10);
+  if (bits < 1 || bits > bayon::FeatureHasher::MAX_BITS) {
+    fprintf(stderr, "[ERROR]Bits of hashed keys must be 1 - %zd: \"%s\"\n",
+            bayon::FeatureHasher::MAX_BITS, oit->second.c_str());
+    return false;
+  }
+  return true;
+}
+
+/*
+ * restore the names and the signs of hashed keys in the top items of
+ * vectors (values are output without the signs of hashed keys)
+ */
+static void restore_key_names(std::istream &is,
+                              const bayon::FeatureHasher &hasher,
+                              const KeyMap *keymap,
+                              const std::vector<const bayon::Vector *>
+                                &vectors,
+                              size_t max_vec, VecKey2Str &veckey2str,
+                              KeySign &signs) {
+  // standard input cannot be read again (keys are output as numbers)
+  if (&is == &std::cin) return;
+
+  bayon::HashMap<bayon::VecKey, bool>::type targets;
+  bayon::init_hash_map(bayon::VECTOR_EMPTY_KEY, targets);
+  std::vector<bayon::VecItem> items;
+  for (size_t i = 0; i < vectors.size(); i++) {
+    vectors[i]->sorted_items_abs(items);
+    for (size_t j = 0; j < items.size() && j < max_vec; j++) {
+      targets[items[j].first] = true;
+    }
+  }
+
+  // the first name of colliding keys is used
+  is.clear();
+  is.seekg(0, std::ios_base::beg);
+  std::string line;
+  size_t nrestored = 0;
+  while (nrestored < targets.size() && std::getline(is, line)) {
+    size_t p = line.find(bayon::DELIMITER);
+    while (p != line.npos) {
+      p += bayon::DELIMITER.size();
+      size_t q = line.find(bayon::DELIMITER, p);
+      size_t len = (q == line.npos ? line.size() : q) - p;
+      bayon::VecValue sign;
+      bayon::VecKey key = hasher.find(line.data() + p, len, sign);
+      bool found = len > 0;
+      if (found && keymap) {
+        KeyMap::const_iterator itk = keymap->find(key);
+        found = itk != keymap->end();
+        if (found) key = VEC_START_KEY + itk->second;
+      }
+      if (found && targets.find(key) != targets.end()
+          && veckey2str.find(key) == veckey2str.end()) {
+        veckey2str[key].assign(line, p, len);
+        signs[key] = sign;
+        nrestored++;
+      }
+      if (q == line.npos) break;
+      p = line.find(bayon::DELIMITER, q + bayon::DELIMITER.size());
+    }
+  }
+}
+
+static int execute_clustering(const Option &option, std::istream &is_doc) {
   DocId2Str docid2str;
   bayon::init_hash_map(bayon::DOC_EMPTY_KEY, docid2str);
   VecKey2Str veckey2str;
@@ -434,13 +1341,119 @@ static int execute_clustering(const Option &option, std::ifstream &ifs_doc) {
   Str2VecKey str2veckey;
   bayon::init_hash_map("", str2veckey);
   bayon::VecKey veckey = VEC_START_KEY;
+  size_t hash_bits;
+  if (!parse_hash_bits(option, hash_bits)) return EXIT_FAILURE;
+  bayon::FeatureHasher hasher(hash_bits,
+                              option.find(OPT_HASH_SIGN) != option.end());
 
   bayon::Analyzer analyzer;
-  read_documents(ifs_doc, analyzer, veckey, docid2str, veckey2str, str2veckey);
+  size_t ndocs = read_documents(is_doc, analyzer,
+                                hash_bits > 0 ? &hasher : NULL, veckey,
+                                docid2str, veckey2str, str2veckey);
   Option::const_iterator oit;
-  if (option.find(OPT_IDF) != option.end()) analyzer.idf();
+  if (option.find(OPT_DF_LOAD) != option.end()) {
+    fprintf(stderr, "[ERROR]Saved document frequency is for classification: ");
+    fprintf(stderr, "--df-load\n");
+    return EXIT_FAILURE;
+  }
+  if ((oit = option.find(OPT_DF_SAVE)) != option.end()) {
+    if (hash_bits > 0) {
+      fprintf(stderr, "[ERROR]Hashed keys cannot be saved: ");
+      fprintf(stderr, "--df-save\n");
+      return EXIT_FAILURE;
+    }
+    std::ofstream ofs(oit->second.c_str());
+    if (!ofs) {
+      fprintf(stderr, "[ERROR]Cannot open file: %s\n", oit->second.c_str());
+      return EXIT_FAILURE;
+    }
+    DocFreq df;
+    bayon::init_hash_map(bayon::VECTOR_EMPTY_KEY, df);
+    analyzer.count_df(df);
+    save_document_frequency(ofs, df, ndocs, veckey2str);
+  }
+  KeyMap keymap;
+  bayon::init_hash_map(bayon::VECTOR_EMPTY_KEY, keymap);
+  bool df_order = option.find(OPT_DF_ORDER) != option.end();
+  bool pruned = option.find(OPT_MIN_DF) != option.end()
+                || option.find(OPT_MAX_DF) != option.end() || df_order;
+  if (pruned) {
+    size_t min_df = (oit = option.find(OPT_MIN_DF)) != option.end() ?
+      parse_df_limit(oit->second, ndocs, false) : 0;
+    size_t max_df = (oit = option.find(OPT_MAX_DF)) != option.end() ?
+      parse_df_limit(oit->second, ndocs, true) : ndocs;
+    prune_features(min_df, max_df, analyzer, veckey, veckey2str, str2veckey,
+                   keymap, df_order);
+  }
+  if (option.find(OPT_IDF) != option.end()) {
+    size_t sketch_memory = (oit = option.find(OPT_DF_SKETCH)) != option.end() ?
+      strtoul(oit->second.c_str(), NULL, 10) * 1024 * 1024 : 0;
+    if (sketch_memory > 0) {
+      bayon::CountMinSketch sketch(
+        bayon::CountMinSketch::width_for_memory(
+          sketch_memory, bayon::CountMinSketch::DEFAULT_DEPTH),
+        bayon::CountMinSketch::DEFAULT_DEPTH);
+      if ((oit = option.find(OPT_DF_HEAVY)) != option.end())
+        sketch.set_heavy_size(strtoul(oit->second.c_str(), NULL, 10));
+      analyzer.idf(sketch);
+    } else {
+      analyzer.idf();
+    }
+  }
   if ((oit = option.find(OPT_VECTOR_SIZE)) != option.end())
     analyzer.resize_document_features(atoi(oit->second.c_str()));
+  size_t projection_dim = 0;
+  if ((oit = option.find(OPT_PROJECTION)) != option.end()) {
+    projection_dim = strtoul(oit->second.c_str(), NULL, 10);
+    analyzer.set_projection_dim(projection_dim);
+  }
+  if (option.find(OPT_REORDER) != option.end()) {
+    if (projection_dim == 0) {
+      fprintf(stderr, "[ERROR]Reordering documents needs --projection\n");
+      return EXIT_FAILURE;
+    }
+    analyzer.set_reorder_flag(true);
+  }
+  if ((oit = option.find(OPT_LAZY_SAMPLE)) != option.end())
+    analyzer.set_lazy_sample_size(strtoul(oit->second.c_str(), NULL, 10));
+  if ((oit = option.find(OPT_BISECTION_SAMPLE)) != option.end()) {
+    size_t sample_size = strtoul(oit->second.c_str(), NULL, 10);
+    unsigned int refine_loop =
+      ((oit = option.find(OPT_SAMPLE_REFINE)) != option.end()) ?
+      atoi(oit->second.c_str()) : 1;
+    analyzer.set_bisection_sample_size(sample_size, refine_loop);
+  }
+  if ((oit = option.find(OPT_THREAD)) != option.end()) {
+    int nthreads = atoi(oit->second.c_str());
+    if (nthreads < 1) {
+      fprintf(stderr, "[ERROR]The number of threads must be more than zero: ");
+      fprintf(stderr, "\"%s\"\n", oit->second.c_str());
+      return EXIT_FAILURE;
+    }
+    analyzer.set_thread_size(nthreads);
+  }
+  if ((oit = option.find(OPT_BRANCH)) != option.end()) {
+    int nbranches = atoi(oit->second.c_str());
+    if (nbranches < 2) {
+      fprintf(stderr, "[ERROR]The number of branches must be more than one: ");
+      fprintf(stderr, "\"%s\"\n", oit->second.c_str());
+      return EXIT_FAILURE;
+    }
+    analyzer.set_branch_size(nbranches);
+  }
+  if ((oit = option.find(OPT_REFINE_LOOP)) != option.end()) {
+    int refine_loop = atoi(oit->second.c_str());
+    if (refine_loop < 1) {
+      fprintf(stderr, "[ERROR]The count of refinement loop must be more than zero: ");
+      fprintf(stderr, "\"%s\"\n", oit->second.c_str());
+      return EXIT_FAILURE;
+    }
+    analyzer.set_refine_loop(refine_loop);
+  }
+  if ((oit = option.find(OPT_REFINE_TOLERANCE)) != option.end())
+    analyzer.set_refine_tolerance(atof(oit->second.c_str()));
+  if (option.find(OPT_REFINE_ACTIVE) != option.end())
+    analyzer.set_refine_active_set(true);
   if ((oit = option.find(OPT_SEED)) != option.end()) {
     unsigned int seed = static_cast<unsigned int>(atoi(oit->second.c_str()));
     analyzer.set_seed(seed);
@@ -468,27 +1481,60 @@ static int execute_clustering(const Option &option, std::ifstream &ifs_doc) {
       return EXIT_FAILURE;
     }
   }
+  if (option.find(OPT_CLTREE) != option.end()) {
+    if (method != bayon::Analyzer::RB) {
+      fprintf(stderr, "[ERROR]Cluster tree needs rb method\n");
+      return EXIT_FAILURE;
+    }
+    analyzer.set_tree_flag(true);
+  }
   analyzer.do_clustering(method);
   std::vector<bayon::Cluster *> clusters = analyzer.clusters();
 
   bool flag_point = (option.find(OPT_POINT) != option.end()) ? true : false;
   show_clusters(clusters, docid2str, flag_point);
 
+  size_t max_vec = ((oit = option.find(OPT_CLVECTOR_SIZE)) != option.end()) ?
+    atoi(oit->second.c_str()) : DEFAULT_MAX_CLVECTOR;
+  KeySign signs;
+  bayon::init_hash_map(bayon::VECTOR_EMPTY_KEY, signs);
+  if (hash_bits > 0 && (option.find(OPT_CLVECTOR) != option.end()
+                        || option.find(OPT_CLTREE) != option.end())) {
+    // names are kept only for the keys to be output
+    std::vector<const bayon::Vector *> vectors;
+    for (size_t i = 0; i < clusters.size(); i++) {
+      if (clusters[i]->size() > 0)
+        vectors.push_back(clusters[i]->centroid_vector());
+    }
+    const std::vector<bayon::Analyzer::TreeNode> &tree =
+      analyzer.cluster_tree();
+    for (size_t i = 0; i < tree.size(); i++) {
+      if (tree[i].cluster < 0) vectors.push_back(&tree[i].centroid);
+    }
+    restore_key_names(is_doc, hasher, pruned ? &keymap : NULL, vectors,
+                      max_vec, veckey2str, signs);
+  }
   if ((oit = option.find(OPT_CLVECTOR)) != option.end()) {
     std::ofstream ofs(oit->second.c_str());
     if (!ofs) {
       fprintf(stderr, "[ERROR]Cannot open file: %s\n", oit->second.c_str());
       return EXIT_FAILURE;
     }
-    size_t max_vec = ((oit = option.find(OPT_CLVECTOR_SIZE)) != option.end()) ?
-      atoi(oit->second.c_str()) : DEFAULT_MAX_CLVECTOR;
-    save_cluster_vector(max_vec, ofs, clusters, veckey2str);
+    save_cluster_vector(max_vec, ofs, clusters, veckey2str, signs);
+  }
+  if ((oit = option.find(OPT_CLTREE)) != option.end()) {
+    std::ofstream ofs(oit->second.c_str());
+    if (!ofs) {
+      fprintf(stderr, "[ERROR]Cannot open file: %s\n", oit->second.c_str());
+      return EXIT_FAILURE;
+    }
+    save_cluster_tree(max_vec, ofs, analyzer, veckey2str, signs);
   }
   return EXIT_SUCCESS;
 }
 
 static int execute_classification(const Option &option,
-                                  std::ifstream &ifs_doc) {
+                                  std::istream &is_doc) {
   DocId2Str docid2str;
   bayon::init_hash_map(bayon::DOC_EMPTY_KEY, docid2str);
   VecKey2Str veckey2str;
@@ -496,31 +1542,40 @@ static int execute_classification(const Option &option,
   Str2VecKey str2veckey;
   bayon::init_hash_map("", str2veckey);
   bayon::VecKey veckey = VEC_START_KEY;
-  bayon::DocumentId docid;
-  std::string line;
   size_t ndocs = 0;
-  bayon::HashMap<bayon::VecKey, size_t>::type df;
+  DocFreq df;
   bayon::init_hash_map(bayon::VECTOR_EMPTY_KEY, df);
+  bool frozen = option.find(OPT_FROZEN_VOCAB) != option.end();
+  size_t hash_bits;
+  if (!parse_hash_bits(option, hash_bits)) return EXIT_FAILURE;
+  if (frozen && hash_bits > 0) {
+    fprintf(stderr, "[ERROR]Hashed keys have no vocabulary: --frozen-vocab\n");
+    return EXIT_FAILURE;
+  }
+  bayon::FeatureHasher feature_hasher(
+    hash_bits, option.find(OPT_HASH_SIGN) != option.end());
+  const bayon::FeatureHasher *hasher = hash_bits > 0 ? &feature_hasher : NULL;
 
-  if (option.find(OPT_IDF) != option.end()) {
-    docid = DOC_START_ID;
-    while (std::getline(ifs_doc, line)) {
-      bayon::Document doc(docid);
-      read_document(line, doc, veckey, docid2str, veckey2str, str2veckey);
-      bayon::VecHashMap *hmap = doc.feature()->hash_map();
-      for (bayon::VecHashMap::iterator it = hmap->begin();
-        it != hmap->end(); ++it) {
-        if (df.find(it->first) == df.end()) df[it->first] = 1;
-        else                                df[it->first]++;
-      }
-      ndocs++;
-    }
-    ifs_doc.clear();
-    ifs_doc.seekg(0, std::ios_base::beg);
+  Option::const_iterator oit = option.find(OPT_DF_SKETCH);
+  size_t sketch_memory = oit != option.end() ?
+    strtoul(oit->second.c_str(), NULL, 10) * 1024 * 1024 : 0;
+  bayon::CountMinSketch sketch(
+    bayon::CountMinSketch::width_for_memory(
+      sketch_memory, bayon::CountMinSketch::DEFAULT_DEPTH),
+    bayon::CountMinSketch::DEFAULT_DEPTH);
+  if ((oit = option.find(OPT_DF_HEAVY)) != option.end())
+    sketch.set_heavy_size(strtoul(oit->second.c_str(), NULL, 10));
+  bayon::CountMinSketch *df_sketch = sketch_memory > 0 ? &sketch : NULL;
+
+  if (!frozen && !prepare_document_frequency(option, is_doc, NULL, hasher,
+                                             veckey, docid2str, veckey2str,
+                                             str2veckey, df, df_sketch,
+                                             ndocs)) {
+    return EXIT_FAILURE;
   }
 
   bayon::Classifier classifier;
-  Option::const_iterator oit = option.find(OPT_CLASSIFY);
+  oit = option.find(OPT_CLASSIFY);
   std::ifstream ifs_cla(oit->second.c_str());
   if (!ifs_cla) {
     fprintf(stderr, "[ERROR]File not found: %s\n", oit->second.c_str());
@@ -532,21 +1587,141 @@ static int execute_classification(const Option &option,
     atoi(oit->second.c_str()) : DEFAULT_MAX_INDEX;
   size_t max_output = (oit = option.find(OPT_CLASSIFY_SIZE)) != option.end() ?
     atoi(oit->second.c_str()) : DEFAULT_MAX_CLASSIFY;
+  if ((oit = option.find(OPT_CLASSIFY_METHOD)) != option.end()) {
+    if (oit->second == "accum") {
+      classifier.set_scoring(bayon::Classifier::ACCUMULATE);
+    } else if (oit->second == "maxscore") {
+      classifier.set_scoring(bayon::Classifier::MAXSCORE);
+    } else if (oit->second == "dense") {
+      classifier.set_scoring(bayon::Classifier::DENSE);
+    } else if (oit->second == "hnsw") {
+      classifier.set_scoring(bayon::Classifier::HNSW);
+    } else if (oit->second == "tree") {
+      if (option.find(OPT_CLASSIFY_TREE) == option.end()) {
+        fprintf(stderr, "[ERROR]Cluster tree is required: --classify-tree\n");
+        return EXIT_FAILURE;
+      }
+      classifier.set_scoring(bayon::Classifier::TREE);
+    } else if (oit->second == "exact") {
+      // do nothing
+    } else {
+      fprintf(stderr, "[ERROR]Illegal classification method: %s\n",
+              oit->second.c_str());
+      return EXIT_FAILURE;
+    }
+  }
+  if ((oit = option.find(OPT_RESCORE_SIZE)) != option.end())
+    classifier.set_rescore_size(atoi(oit->second.c_str()));
+  classifier.set_result_size(max_output);
 
   DocId2Str claid2str;
   bayon::init_hash_map(bayon::DOC_EMPTY_KEY, claid2str);
-  read_classifier_vectors(max_index, ifs_cla, classifier, veckey,
+  read_classifier_vectors(max_index, ifs_cla, classifier, hasher, veckey,
                           claid2str, veckey2str, str2veckey);
-  docid = DOC_START_ID;
-  while (std::getline(ifs_doc, line)) {
-    bayon::Document doc(docid);
-    read_document(line, doc, veckey, docid2str, veckey2str, str2veckey);
-    if (option.find(OPT_IDF) != option.end()) doc.idf(df, ndocs);
-    if ((oit = option.find(OPT_VECTOR_SIZE)) != option.end())
-      doc.feature()->resize(atoi(oit->second.c_str()));
-    doc.feature()->normalize();
-    show_classified(max_keys, max_output, classifier,
-                    doc, docid2str, claid2str);
+  if ((oit = option.find(OPT_CLASSIFY_METHOD)) != option.end()
+      && oit->second == "dense") {
+    classifier.build_dense_matrix();
+  }
+  if ((oit = option.find(OPT_CLASSIFY_METHOD)) != option.end()
+      && oit->second == "hnsw") {
+    if ((oit = option.find(OPT_HNSW_LOAD)) != option.end()) {
+      std::ifstream ifs_hnsw(oit->second.c_str());
+      if (!ifs_hnsw) {
+        fprintf(stderr, "[ERROR]File not found: %s\n", oit->second.c_str());
+        return EXIT_FAILURE;
+      }
+      if (!classifier.load_hnsw_index(ifs_hnsw)) {
+        fprintf(stderr, "[ERROR]Illegal hnsw graph: %s\n", oit->second.c_str());
+        return EXIT_FAILURE;
+      }
+    } else {
+      size_t max_links = (oit = option.find(OPT_HNSW_M)) != option.end() ?
+        atoi(oit->second.c_str()) : bayon::HnswIndex::DEFAULT_MAX_LINKS;
+      size_t ef_construction =
+        (oit = option.find(OPT_HNSW_EF_CONSTRUCTION)) != option.end() ?
+        strtoul(oit->second.c_str(), NULL, 10) :
+        bayon::HnswIndex::DEFAULT_EF_CONSTRUCTION;
+      classifier.build_hnsw_index(max_links, ef_construction);
+    }
+    if ((oit = option.find(OPT_HNSW_EF)) != option.end())
+      classifier.set_hnsw_ef(atoi(oit->second.c_str()));
+    if ((oit = option.find(OPT_HNSW_SAVE)) != option.end()) {
+      std::ofstream ofs_hnsw(oit->second.c_str());
+      if (!ofs_hnsw) {
+        fprintf(stderr, "[ERROR]Cannot open file: %s\n", oit->second.c_str());
+        return EXIT_FAILURE;
+      }
+      classifier.save_hnsw_index(ofs_hnsw);
+    }
+  }
+
+  if ((oit = option.find(OPT_CLASSIFY_TREE)) != option.end()) {
+    std::ifstream ifs_tree(oit->second.c_str());
+    if (!ifs_tree) {
+      fprintf(stderr, "[ERROR]File not found: %s\n", oit->second.c_str());
+      return EXIT_FAILURE;
+    }
+    if (!read_classifier_tree(ifs_tree, classifier, hasher, veckey, claid2str,
+                              veckey2str, str2veckey)) {
+      fprintf(stderr, "[ERROR]Illegal cluster tree: %s\n", oit->second.c_str());
+      return EXIT_FAILURE;
+    }
+  }
+  if ((oit = option.find(OPT_BEAM)) != option.end())
+    classifier.set_beam_size(atoi(oit->second.c_str()));
+  if ((oit = option.find(OPT_CACHE_SIZE)) != option.end())
+    classifier.set_cache_memory(strtoul(oit->second.c_str(), NULL, 10)
+                                * 1024 * 1024);
+
+  // the keys of target vectors are frozen and others are ignored
+  bayon::Vocabulary vocab;
+  if (frozen) {
+    std::vector<bayon::Vocabulary::Term> terms(str2veckey.begin(),
+                                               str2veckey.end());
+    if (!vocab.build(terms)) {
+      fprintf(stderr, "[ERROR]Cannot build the vocabulary of target vectors\n");
+      return EXIT_FAILURE;
+    }
+    Str2VecKey empty;
+    bayon::init_hash_map("", empty);
+    str2veckey.swap(empty);
+    if (!prepare_document_frequency(option, is_doc, &vocab, NULL, veckey,
+                                    docid2str, veckey2str, str2veckey,
+                                    df, df_sketch, ndocs)) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  ClassifyConfig config;
+  config.classifier = &classifier;
+  config.claid2str = &claid2str;
+  config.df = (option.find(OPT_IDF) != option.end()
+               || option.find(OPT_DF_LOAD) != option.end()) ? &df : NULL;
+  config.df_sketch = config.df ? df_sketch : NULL;
+  config.ndocs = ndocs;
+  config.vector_size = ((oit = option.find(OPT_VECTOR_SIZE)) != option.end()) ?
+    atoi(oit->second.c_str()) : 0;
+  config.max_keys = max_keys;
+  config.max_output = max_output;
+  size_t nthreads = 1;
+  if ((oit = option.find(OPT_THREAD)) != option.end()) {
+    int nthreads_option = atoi(oit->second.c_str());
+    if (nthreads_option < 1) {
+      fprintf(stderr, "[ERROR]The number of threads must be more than zero: ");
+      fprintf(stderr, "\"%s\"\n", oit->second.c_str());
+      return EXIT_FAILURE;
+    }
+    nthreads = nthreads_option;
+  }
+  if (!classify_documents(config, nthreads, frozen ? &vocab : NULL, hasher,
+                          is_doc, veckey, docid2str, veckey2str,
+                          str2veckey)) {
+    fprintf(stderr, "[ERROR]Cannot create threads of classification\n");
+    return EXIT_FAILURE;
+  }
+  if (classifier.cache()) {
+    fprintf(stderr, "cache hits: %zd, misses: %zd\n",
+            classifier.cache()->hits(), classifier.cache()->misses());
   }
   return EXIT_SUCCESS;
 }
@@ -30,6 +30,7 @@
 #include "cluster.h"
 #include "document.h"
 #include "util.h"
+#include "vocab.h"
 
 #endif  // BAYON_BAYON_H_
 
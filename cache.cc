@@ -0,0 +1,218 @@
+//
+// Cache of similar vectors for queries
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#include <algorithm>
+#include <cmath>
+#include "cache.h"
+
+namespace bayon {
+
+const size_t QueryCache::DEFAULT_KEY_SIZE;
+const int QueryCache::DEFAULT_QUANTIZE_LEVEL;
+const size_t QueryCache::EMPTY_HASH;
+const size_t QueryCache::DELETED_HASH;
+const size_t QueryCache::ENTRY_OVERHEAD;
+
+/**
+ * Constructor.
+ */
+QueryCache::QueryCache(size_t max_memory)
+  : max_memory_(max_memory), memory_(0), key_size_(DEFAULT_KEY_SIZE),
+    quantize_level_(DEFAULT_QUANTIZE_LEVEL), hits_(0), misses_(0) {
+  init_hash_map(EMPTY_HASH, index_);
+#ifdef HAVE_GOOGLE_DENSE_HASH_MAP
+  index_.set_deleted_key(DELETED_HASH);
+#endif
+  pthread_mutex_init(&mutex_, NULL);
+}
+
+/**
+ * Make the key of a query.
+ */
+size_t QueryCache::make_key(const Vector &vec, size_t max,
+                            std::vector<KeyItem> &key) const {
+  // parameters may be changed by other threads
+  pthread_mutex_lock(&mutex_);
+  size_t key_size = key_size_;
+  int quantize_level = quantize_level_;
+  pthread_mutex_unlock(&mutex_);
+
+  std::vector<VecItem> items;
+  vec.sorted_items_abs(items);
+  if (key_size > 0 && items.size() > key_size) items.resize(key_size);
+  for (size_t i = 0; i < items.size(); i++) {
+    int value = static_cast<int>(floor(items[i].second * quantize_level + 0.5));
+    key.push_back(KeyItem(items[i].first, value));
+  }
+  std::sort(key.begin(), key.end());
+
+  // FNV-1a hash
+  size_t hash = static_cast<size_t>(14695981039346656037ULL);
+  const size_t prime = static_cast<size_t>(1099511628211ULL);
+  hash = (hash ^ max) * prime;
+  for (size_t i = 0; i < key.size(); i++) {
+    hash = (hash ^ static_cast<size_t>(key[i].first)) * prime;
+    hash = (hash ^ static_cast<size_t>(key[i].second)) * prime;
+  }
+  if (hash == EMPTY_HASH || hash == DELETED_HASH) hash -= 2;
+  return hash;
+}
+
+/**
+ * Remove the least recently used entries over the memory budget.
+ */
+void QueryCache::evict() {
+  while (memory_ > max_memory_ && !entries_.empty()) {
+    index_.erase(entries_.back().hash);
+    memory_ -= entries_.back().memory;
+    entries_.pop_back();
+  }
+}
+
+/**
+ * Remove all entries.
+ */
+void QueryCache::remove_entries() {
+  entries_.clear();
+  index_.clear();
+  memory_ = 0;
+}
+
+/**
+ * Set the number of query items in a cache key.
+ */
+void QueryCache::set_key_size(size_t siz) {
+  pthread_mutex_lock(&mutex_);
+  key_size_ = siz;
+  remove_entries();
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * Set the number of quantization levels of unit values.
+ */
+void QueryCache::set_quantize_level(int level) {
+  pthread_mutex_lock(&mutex_);
+  quantize_level_ = level > 0 ? level : 1;
+  remove_entries();
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * Look up the results of a query.
+ */
+bool QueryCache::lookup(const Vector &vec, size_t max,
+                        std::vector<Result> &results) {
+  std::vector<KeyItem> key;
+  size_t hash = make_key(vec, max, key);
+  bool found = false;
+  pthread_mutex_lock(&mutex_);
+  HashMap<size_t, EntryList::iterator>::type::iterator it = index_.find(hash);
+  if (it != index_.end() && it->second->max == max && it->second->key == key) {
+    entries_.splice(entries_.begin(), entries_, it->second);
+    results.insert(results.end(), it->second->results.begin(),
+                   it->second->results.end());
+    found = true;
+    hits_++;
+  } else {
+    misses_++;
+  }
+  pthread_mutex_unlock(&mutex_);
+  return found;
+}
+
+/**
+ * Store the results of a query.
+ */
+void QueryCache::insert(const Vector &vec, size_t max,
+                        const std::vector<Result> &results) {
+  Entry entry;
+  entry.hash = make_key(vec, max, entry.key);
+  entry.max = max;
+  entry.results = results;
+  entry.memory = sizeof(Entry) + ENTRY_OVERHEAD
+                 + entry.key.capacity() * sizeof(KeyItem)
+                 + entry.results.capacity() * sizeof(Result);
+  if (entry.memory > max_memory_) return;
+
+  pthread_mutex_lock(&mutex_);
+  HashMap<size_t, EntryList::iterator>::type::iterator it =
+    index_.find(entry.hash);
+  if (it != index_.end()) {  // replace the entry of the same hash
+    memory_ -= it->second->memory;
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+  entries_.push_front(entry);
+  index_[entry.hash] = entries_.begin();
+  memory_ += entry.memory;
+  evict();
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * Remove all entries.
+ */
+void QueryCache::clear() {
+  pthread_mutex_lock(&mutex_);
+  remove_entries();
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * Get the number of cache hits.
+ */
+size_t QueryCache::hits() const {
+  pthread_mutex_lock(&mutex_);
+  size_t count = hits_;
+  pthread_mutex_unlock(&mutex_);
+  return count;
+}
+
+/**
+ * Get the number of cache misses.
+ */
+size_t QueryCache::misses() const {
+  pthread_mutex_lock(&mutex_);
+  size_t count = misses_;
+  pthread_mutex_unlock(&mutex_);
+  return count;
+}
+
+/**
+ * Get the number of entries.
+ */
+size_t QueryCache::size() const {
+  pthread_mutex_lock(&mutex_);
+  size_t count = entries_.size();
+  pthread_mutex_unlock(&mutex_);
+  return count;
+}
+
+/**
+ * Get the memory size used by entries.
+ */
+size_t QueryCache::memory_size() const {
+  pthread_mutex_lock(&mutex_);
+  size_t siz = memory_;
+  pthread_mutex_unlock(&mutex_);
+  return siz;
+}
+
+} /* namespace bayon */
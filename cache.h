@@ -0,0 +1,193 @@
+//
+// Cache of similar vectors for queries
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#ifndef BAYON_CACHE_H_
+#define BAYON_CACHE_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include <list>
+#include <utility>
+#include <vector>
+#include "byvector.h"
+
+namespace bayon {
+
+/**
+ * QueryCache class.
+ * LRU cache of the results of similar vectors.
+ * A query is identified by its items with the largest absolute values,
+ * whose values are quantized, so near-identical queries share a result.
+ * All methods are thread-safe.
+ */
+class QueryCache {
+ public:
+  /** the identifier of a result */
+  typedef long ResultId;
+  /** a pair of an identifier and a similarity point */
+  typedef std::pair<ResultId, double> Result;
+
+  /** default number of query items in a cache key */
+  static const size_t DEFAULT_KEY_SIZE = 32;
+  /** default number of quantization levels of unit values */
+  static const int DEFAULT_QUANTIZE_LEVEL = 1024;
+
+ private:
+  /** a quantized item of a query */
+  typedef std::pair<VecKey, int> KeyItem;
+
+  static const size_t EMPTY_HASH = static_cast<size_t>(-1);    ///< empty key
+  static const size_t DELETED_HASH = static_cast<size_t>(-2);  ///< deleted key
+  /** estimated memory size of a list node and an index slot */
+  static const size_t ENTRY_OVERHEAD = 64;
+
+  /**
+   * Cache entry.
+   */
+  struct Entry {
+    size_t hash;                   ///< hash value of the key
+    size_t max;                    ///< the parameter of a query
+    std::vector<KeyItem> key;      ///< quantized items sorted by keys
+    std::vector<Result> results;   ///< results
+    size_t memory;                 ///< memory size of this entry
+  };
+  typedef std::list<Entry> EntryList;
+
+  EntryList entries_;                                  ///< recent first
+  HashMap<size_t, EntryList::iterator>::type index_;   ///< entries by hash
+  size_t max_memory_;                                  ///< memory budget
+  size_t memory_;                                      ///< used memory
+  size_t key_size_;                                    ///< items in a key
+  int quantize_level_;                                 ///< quantization
+  size_t hits_;                                        ///< count of hits
+  size_t misses_;                                      ///< count of misses
+  mutable pthread_mutex_t mutex_;                      ///< lock
+
+  /**
+   * Make the key of a query.
+   * @param vec a query vector
+   * @param max the parameter of a query
+   * @param key output quantized items
+   * @return hash value of the key
+   */
+  size_t make_key(const Vector &vec, size_t max,
+                  std::vector<KeyItem> &key) const;
+
+  /**
+   * Remove the least recently used entries over the memory budget.
+   */
+  void evict();
+
+  /**
+   * Remove all entries (the lock must be held).
+   */
+  void remove_entries();
+
+  /**
+   * Copy constructor (disabled).
+   */
+  QueryCache(const QueryCache &cache);
+
+  /**
+   * Assignment operator (disabled).
+   */
+  QueryCache &operator=(const QueryCache &cache);
+
+ public:
+  /**
+   * Constructor.
+   * @param max_memory memory budget in bytes
+   */
+  explicit QueryCache(size_t max_memory);
+
+  /**
+   * Destructor.
+   */
+  ~QueryCache() {
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  /**
+   * Set the number of query items in a cache key.
+   * The cache is cleared.
+   * @param siz the number of items (0: all)
+   */
+  void set_key_size(size_t siz);
+
+  /**
+   * Set the number of quantization levels of unit values.
+   * The cache is cleared.
+   * @param level quantization levels
+   */
+  void set_quantize_level(int level);
+
+  /**
+   * Look up the results of a query.
+   * @param vec a query vector
+   * @param max the parameter of a query
+   * @param results output results
+   * @return true if the results are cached
+   */
+  bool lookup(const Vector &vec, size_t max, std::vector<Result> &results);
+
+  /**
+   * Store the results of a query.
+   * @param vec a query vector
+   * @param max the parameter of a query
+   * @param results results
+   */
+  void insert(const Vector &vec, size_t max,
+              const std::vector<Result> &results);
+
+  /**
+   * Remove all entries.
+   */
+  void clear();
+
+  /**
+   * Get the number of cache hits.
+   * @return the number of hits
+   */
+  size_t hits() const;
+
+  /**
+   * Get the number of cache misses.
+   * @return the number of misses
+   */
+  size_t misses() const;
+
+  /**
+   * Get the number of entries.
+   * @return the number of entries
+   */
+  size_t size() const;
+
+  /**
+   * Get the memory size used by entries.
+   * @return the size in bytes
+   */
+  size_t memory_size() const;
+};
+
+} /* namespace bayon */
+
+#endif  // BAYON_CACHE_H_
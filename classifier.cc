@@ -18,28 +18,137 @@
 //
 
 #include <algorithm>
+#include <functional>
+#include <queue>
+#include <sched.h>
 #include "classifier.h"
 
+namespace {
+
+/**
+ * Cursor of a posting list for document-at-a-time traversal.
+ */
+struct PostingCursor {
+  bayon::PostingList::Cursor cursor;  ///< cursor of a posting list
+  double weight;  ///< weight of the query key
+  double bound;   ///< upper bound of the contribution to points
+};
+
+/**
+ * Compare cursors by upper bounds.
+ */
+bool less_cursor_bound(const PostingCursor &left, const PostingCursor &right) {
+  return left.bound < right.bound;
+}
+
+} /* namespace */
+
 namespace bayon {
 
 const Classifier::VectorId Classifier::VECID_EMPTY_KEY;
+const Classifier::VectorId Classifier::VECID_DELETED_KEY;
+const size_t Classifier::COMPACTION_RATIO;
+const size_t Classifier::DEFAULT_BEAM_SIZE;
 
 /**
  * Add vector keys to inverted index.
  */
-void Classifier::update_inverted_index(VectorId id, const Vector &vec) {
+void Classifier::update_inverted_index(VectorIndex index, const Vector &vec) {
   std::vector<VecItem> items;
   vec.sorted_items_abs(items);
   for (size_t i = 0; i < items.size(); i++) {
-    IndexItem p;
-    p.first = id;
-    p.second = items[i].second;
-    if (inverted_index_.find(items[i].first) == inverted_index_.end()) {
-      InvertedIndexValue *v = new InvertedIndexValue;
-      v->push_back(p);
+    InvertedIndex::iterator it = inverted_index_.find(items[i].first);
+    InvertedIndexValue *v;
+    if (it == inverted_index_.end()) {
+      v = new InvertedIndexValue;
       inverted_index_[items[i].first] = v;
     } else {
-      inverted_index_[items[i].first]->push_back(p);
+      v = it->second;
+    }
+    if (index_size_ > 0) {
+      v->add(index, items[i].second, index_size_, &removed_);
+    } else {
+      v->add(index, items[i].second);
+    }
+  }
+}
+
+/**
+ * Add a vector.
+ */
+void Classifier::add_vector(VectorId id, const Vector &vec) {
+  remove_vector(id);
+  Vector &normalized = vectors_[id];
+  normalized = vec;
+  normalized.normalize();
+  VectorIndex index = ids_.size();
+  ids_.push_back(id);
+  removed_.push_back(false);
+  indexes_[id] = index;
+  update_inverted_index(index, normalized);
+  if (hnsw_.size() > 0) hnsw_.add(id, normalized);
+  clear_cache();
+}
+
+/**
+ * Remove a vector.
+ */
+bool Classifier::remove_vector(VectorId id) {
+  HashMap<VectorId, VectorIndex>::type::iterator it = indexes_.find(id);
+  if (it == indexes_.end()) return false;
+  removed_[it->second] = true;
+  nremoved_++;
+  if (index_size_ > 0) {
+    // bounded posting lists drop postings instead of keeping tombstones
+    VecHashMap *hmap = vectors_[id].hash_map();
+    for (VecHashMap::iterator itvec = hmap->begin(); itvec != hmap->end();
+         ++itvec) {
+      InvertedIndex::iterator itidx = inverted_index_.find(itvec->first);
+      if (itidx != inverted_index_.end()) itidx->second->remove(it->second);
+    }
+  }
+  indexes_.erase(it);
+  vectors_.erase(id);
+  clear_cache();
+  if (nremoved_ * COMPACTION_RATIO > ids_.size()) compact();
+  return true;
+}
+
+/**
+ * Purge tombstones from posting lists and renumber internal indexes.
+ */
+void Classifier::compact() {
+  if (nremoved_ == 0) return;
+  std::vector<VectorId> ids;
+  for (size_t i = 0; i < ids_.size(); i++) {
+    if (!removed_[i]) {
+      indexes_[ids_[i]] = ids.size();
+      ids.push_back(ids_[i]);
+    }
+  }
+  ids_.swap(ids);
+  std::vector<bool>(ids_.size(), false).swap(removed_);
+  nremoved_ = 0;
+  dense_size_ = 0;
+
+  // rebuild postings from the stored vectors
+  for (InvertedIndex::iterator it = inverted_index_.begin();
+       it != inverted_index_.end(); ++it) {
+    delete it->second;
+  }
+  inverted_index_.clear();
+  size_t index_size = index_size_;
+  index_size_ = 0;
+  for (size_t i = 0; i < ids_.size(); i++) {
+    update_inverted_index(i, vectors_[ids_[i]]);
+  }
+  if (index_size > 0) resize_inverted_index(index_size);
+
+  // rebuild the graph without the nodes of removed vectors
+  if (hnsw_.size() > 0) {
+    hnsw_.clear();
+    for (size_t i = 0; i < ids_.size(); i++) {
+      hnsw_.add(ids_[i], vectors_[ids_[i]]);
     }
   }
 }
@@ -56,8 +165,9 @@ size_t Classifier::lookup_inverted_index(size_t max, const Vector &vec,
   for (size_t i = 0; i < items.size() && i < max; i++) {
     InvertedIndex::const_iterator itidx = inverted_index_.find(items[i].first);
     if (itidx != inverted_index_.end()) {
-      for (size_t j = 0; j < itidx->second->size(); j++) {
-        idmap[itidx->second->at(j).first] = true;
+      for (PostingList::Cursor cursor(itidx->second); !cursor.end();
+           cursor.next()) {
+        if (!removed_[cursor.id()]) idmap[ids_[cursor.id()]] = true;
       }
     }
   }
@@ -70,23 +180,306 @@ size_t Classifier::lookup_inverted_index(size_t max, const Vector &vec,
 }
 
 /**
- * Resize a inverted index.
- * @param the size of resized index
+ * Accumulate partial inner products from inverted index.
+ */
+void Classifier::accumulate_inverted_index(
+  size_t max, const Vector &vec,
+  std::vector<std::pair<VectorId, double> > &items) const {
+
+  std::vector<double> scores(ids_.size(), 0.0);
+  std::vector<bool> touched(ids_.size(), false);
+  std::vector<VectorIndex> indexes;
+  std::vector<VecItem> keys;
+  vec.sorted_items_abs(keys);
+  for (size_t i = 0; i < keys.size() && (max == 0 || i < max); i++) {
+    InvertedIndex::const_iterator itidx = inverted_index_.find(keys[i].first);
+    if (itidx == inverted_index_.end()) continue;
+    for (PostingList::Cursor cursor(itidx->second); !cursor.end();
+         cursor.next()) {
+      VectorIndex index = cursor.id();
+      if (removed_[index]) continue;
+      if (!touched[index]) {
+        touched[index] = true;
+        indexes.push_back(index);
+      }
+      scores[index] += keys[i].second * cursor.weight();
+    }
+  }
+
+  for (size_t i = 0; i < indexes.size(); i++) {
+    if (scores[indexes[i]] != 0) {
+      items.push_back(std::pair<VectorId, double>(ids_[indexes[i]],
+                                                  scores[indexes[i]]));
+    }
+  }
+}
+
+/**
+ * Get the top similar vectors with MaxScore dynamic pruning.
+ */
+void Classifier::maxscore_inverted_index(
+  size_t max, const Vector &vec,
+  std::vector<std::pair<VectorId, double> > &items) const {
+
+  std::vector<PostingCursor> cursors;
+  std::vector<VecItem> keys;
+  vec.sorted_items_abs(keys);
+  for (size_t i = 0; i < keys.size() && (max == 0 || i < max); i++) {
+    InvertedIndex::const_iterator itidx = inverted_index_.find(keys[i].first);
+    if (itidx == inverted_index_.end()) continue;
+    const InvertedIndexValue *postings = itidx->second;
+    PostingCursor cursor;
+    cursor.cursor = PostingList::Cursor(postings);
+    cursor.weight = keys[i].second;
+    cursor.bound = std::max(0.0,
+      std::max(cursor.weight * postings->max_weight(),
+               cursor.weight * postings->min_weight()));
+    cursors.push_back(cursor);
+  }
+  std::sort(cursors.begin(), cursors.end(), less_cursor_bound);
+  std::vector<double> bounds(cursors.size());
+  double sum = 0.0;
+  for (size_t i = 0; i < cursors.size(); i++) {
+    sum += cursors[i].bound;
+    bounds[i] = sum;
+  }
+
+  typedef std::pair<double, VectorIndex> HeapItem;
+  std::priority_queue<HeapItem, std::vector<HeapItem>,
+                      std::greater<HeapItem> > heap;
+  double threshold = 0.0;
+  size_t essential = 0;  // cursors before this are non-essential
+  while (true) {
+    VectorIndex index = ids_.size();
+    for (size_t i = essential; i < cursors.size(); i++) {
+      const PostingList::Cursor &c = cursors[i].cursor;
+      if (!c.end() && c.id() < index) index = c.id();
+    }
+    if (index == ids_.size()) break;
+
+    double score = 0.0;
+    for (size_t i = essential; i < cursors.size(); i++) {
+      PostingList::Cursor &c = cursors[i].cursor;
+      if (!c.end() && c.id() == index) {
+        score += cursors[i].weight * c.weight();
+        c.next();
+      }
+    }
+    if (removed_[index]) continue;
+    for (size_t i = essential; i > 0; i--) {
+      if (heap.size() >= result_size_ && score + bounds[i - 1] <= threshold) {
+        break;
+      }
+      PostingList::Cursor &c = cursors[i - 1].cursor;
+      c.skip_to(index);
+      if (!c.end() && c.id() == index) {
+        score += cursors[i - 1].weight * c.weight();
+      }
+    }
+
+    if (score != 0 && (heap.size() < result_size_ || score > threshold)) {
+      heap.push(HeapItem(score, index));
+      if (heap.size() > result_size_) heap.pop();
+      if (heap.size() >= result_size_) {
+        threshold = heap.top().first;
+        while (essential < cursors.size() && bounds[essential] <= threshold) {
+          essential++;
+        }
+      }
+    }
+  }
+
+  while (!heap.empty()) {
+    items.push_back(std::pair<VectorId, double>(ids_[heap.top().second],
+                                                heap.top().first));
+    heap.pop();
+  }
+}
+
+/**
+ * Calculate exact points with the dense feature-major matrix.
+ */
+void Classifier::dense_inner_products(
+  const Vector &vec,
+  std::vector<std::pair<VectorId, double> > &items) const {
+
+  std::vector<double> scores(dense_stride_, 0.0);
+  double *sp = &scores[0];
+  for (VecHashMap::const_iterator it = vec.hash_map()->begin();
+       it != vec.hash_map()->end(); ++it) {
+    HashMap<VecKey, size_t>::type::const_iterator itrow =
+      dense_rows_.find(it->first);
+    if (itrow == dense_rows_.end()) continue;
+    // contiguous loop over vectors, vectorized by the compiler
+    const double *row = &dense_matrix_[itrow->second * dense_stride_];
+    double weight = it->second;
+    for (size_t i = 0; i < dense_stride_; i++) {
+      sp[i] += weight * row[i];
+    }
+  }
+  for (size_t i = 0; i < dense_size_; i++) {
+    if (scores[i] != 0 && !removed_[i]) {
+      items.push_back(std::pair<VectorId, double>(ids_[i], scores[i]));
+    }
+  }
+}
+
+/**
+ * Build a dense feature-major matrix of all vectors.
+ */
+void Classifier::build_dense_matrix() {
+  static const size_t ALIGN_SIZE = 8;
+  dense_rows_.clear();
+  dense_size_ = ids_.size();
+  dense_stride_ = (dense_size_ + ALIGN_SIZE - 1) / ALIGN_SIZE * ALIGN_SIZE;
+  for (size_t i = 0; i < ids_.size(); i++) {
+    const Vector &vec = vectors_.find(ids_[i])->second;
+    for (VecHashMap::const_iterator it = vec.hash_map()->begin();
+         it != vec.hash_map()->end(); ++it) {
+      if (dense_rows_.find(it->first) == dense_rows_.end()) {
+        size_t row = dense_rows_.size();
+        dense_rows_[it->first] = row;
+      }
+    }
+  }
+
+  std::vector<double>(dense_rows_.size() * dense_stride_, 0.0)
+    .swap(dense_matrix_);
+  for (size_t i = 0; i < ids_.size(); i++) {
+    const Vector &vec = vectors_.find(ids_[i])->second;
+    for (VecHashMap::const_iterator it = vec.hash_map()->begin();
+         it != vec.hash_map()->end(); ++it) {
+      dense_matrix_[dense_rows_[it->first] * dense_stride_ + i] = it->second;
+    }
+  }
+  clear_cache();
+}
+
+/**
+ * Build a HNSW graph of all vectors.
+ */
+void Classifier::build_hnsw_index(size_t max_links, size_t ef_construction) {
+  hnsw_.clear();
+  hnsw_.set_max_links(max_links);
+  hnsw_.set_ef_construction(ef_construction);
+  for (size_t i = 0; i < ids_.size(); i++) {
+    if (!removed_[i]) hnsw_.add(ids_[i], vectors_[ids_[i]]);
+  }
+  clear_cache();
+}
+
+/**
+ * Load a HNSW graph saved for the same vectors.
+ */
+bool Classifier::load_hnsw_index(std::istream &is) {
+  clear_cache();
+  if (!hnsw_.load(is)) return false;
+  for (size_t i = 0; i < hnsw_.size(); i++) {
+    HashMap<VectorId, Vector>::type::const_iterator it =
+      vectors_.find(hnsw_.label(i));
+    if (it == vectors_.end()) {
+      hnsw_.clear();
+      return false;
+    }
+    hnsw_.set_vector(i, it->second);
+  }
+  return true;
+}
+
+/**
+ * Search similar vectors on the HNSW graph.
+ */
+void Classifier::search_hnsw_index(
+  const Vector &vec, std::vector<std::pair<VectorId, double> > &items) const {
+  std::vector<HnswIndex::NodePoint> points;
+  hnsw_.search(vec, result_size_ > 0 ? result_size_ : hnsw_.ef(), points);
+
+  // removed or updated vectors may remain in the graph
+  HashMap<VectorId, bool>::type found;
+  init_hash_map(VECID_EMPTY_KEY, found);
+  for (size_t i = 0; i < points.size(); i++) {
+    VectorId id = hnsw_.label(points[i].first);
+    HashMap<VectorId, Vector>::type::const_iterator it = vectors_.find(id);
+    if (it == vectors_.end() || found.find(id) != found.end()) continue;
+    found[id] = true;
+    double similarity = Vector::inner_product(it->second, vec);
+    if (similarity != 0) {
+      items.push_back(std::pair<VectorId, double>(id, similarity));
+    }
+  }
+}
+
+/**
+ * Add an internal node of a cluster tree.
+ */
+void Classifier::add_tree_node(VectorId id, VectorId parent,
+                               const Vector &vec) {
+  Vector &normalized = tree_vectors_[id];
+  normalized = vec;
+  normalized.normalize();
+  add_tree_leaf(id, parent);
+}
+
+/**
+ * Add a leaf of a cluster tree.
+ */
+void Classifier::add_tree_leaf(VectorId id, VectorId parent) {
+  if (parent < 0) tree_root_ = id;
+  else            tree_children_[parent].push_back(id);
+  clear_cache();
+}
+
+/**
+ * Search similar vectors by beam search on the cluster tree.
+ */
+void Classifier::search_tree(
+  const Vector &vec, std::vector<std::pair<VectorId, double> > &items) const {
+  std::vector<std::pair<VectorId, double> > beam, next;
+  std::vector<VectorId> nodes(1, tree_root_);
+  while (!nodes.empty()) {
+    for (size_t i = 0; i < nodes.size(); i++) {
+      HashMap<VectorId, Vector>::type::const_iterator it;
+      if ((it = vectors_.find(nodes[i])) != vectors_.end()) {  // leaf
+        double similarity = Vector::inner_product(it->second, vec);
+        if (similarity != 0) {
+          items.push_back(std::pair<VectorId, double>(it->first, similarity));
+        }
+      } else if ((it = tree_vectors_.find(nodes[i])) != tree_vectors_.end()) {
+        next.push_back(std::pair<VectorId, double>(
+          it->first, Vector::inner_product(it->second, vec)));
+      }
+    }
+    if (next.size() > beam_size_) {
+      std::partial_sort(next.begin(), next.begin() + beam_size_, next.end(),
+                        greater_pair<VectorId, double>);
+      next.resize(beam_size_);
+    }
+    beam.swap(next);
+    next.clear();
+
+    // expand the children of the best internal nodes
+    nodes.clear();
+    for (size_t i = 0; i < beam.size(); i++) {
+      HashMap<VectorId, std::vector<VectorId> >::type::const_iterator it =
+        tree_children_.find(beam[i].first);
+      if (it != tree_children_.end()) {
+        nodes.insert(nodes.end(), it->second.begin(), it->second.end());
+      }
+    }
+  }
+}
+
+/**
+ * Resize a inverted index and compress posting lists.
  */
 void Classifier::resize_inverted_index(size_t siz) {
+  index_size_ = siz;
   for (InvertedIndex::iterator it = inverted_index_.begin();
        it != inverted_index_.end(); ++it) {
-    if (it->second->size() > siz) {
-      sort(it->second->begin(), it->second->end(),
-           greater_pair_abs<VectorId, double>);
-      InvertedIndexValue *v = new InvertedIndexValue;
-      for (size_t i = 0; i < siz ; i++) {
-        v->push_back(it->second->at(i));
-      }
-      delete it->second;
-      it->second = v;
-    }
+    it->second->truncate(siz);
+    it->second->compress();
   }
+  clear_cache();
 }
 
 /**
@@ -95,8 +488,35 @@ void Classifier::resize_inverted_index(size_t siz) {
 void Classifier::similar_vectors(
   size_t max, const Vector &vec,
   std::vector<std::pair<VectorId, double> > &items) const {
+  if (cache_ && cache_->lookup(vec, max, items)) return;
 
-  if (max > 0) {  // inverted index
+  if (scoring_ == MAXSCORE && result_size_ > 0) {  // top-k with pruning
+    maxscore_inverted_index(max, vec, items);
+  } else if (scoring_ == TREE && tree_root_ != VECID_EMPTY_KEY) {
+    search_tree(vec, items);  // cluster tree
+  } else if (scoring_ == HNSW && hnsw_.size() > 0) {  // graph search
+    search_hnsw_index(vec, items);
+  } else if (scoring_ == DENSE && dense_size_ == ids_.size()
+             && dense_size_ > 0) {  // dense matrix
+    dense_inner_products(vec, items);
+  } else if (scoring_ == ACCUMULATE || scoring_ == MAXSCORE) {
+    // accumulated points
+    accumulate_inverted_index(max, vec, items);
+    if (rescore_size_ > 0) {
+      if (items.size() > rescore_size_) {
+        std::partial_sort(items.begin(), items.begin() + rescore_size_,
+                          items.end(), greater_pair<VectorId, double>);
+        items.resize(rescore_size_);
+      }
+      for (size_t i = 0; i < items.size(); i++) {
+        HashMap<VectorId, Vector>::type::const_iterator it =
+          vectors_.find(items[i].first);
+        if (it != vectors_.end()) {
+          items[i].second = Vector::inner_product(it->second, vec);
+        }
+      }
+    }
+  } else if (max > 0 && scoring_ != DENSE) {  // inverted index
     std::vector<VectorId> ids;
     lookup_inverted_index(max, vec, ids);
     for (size_t i = 0; i < ids.size(); i++) {
@@ -118,7 +538,55 @@ void Classifier::similar_vectors(
     }
   }
 
-  std::sort(items.begin(), items.end(), greater_pair<VectorId, double>);
+  if (result_size_ > 0 && items.size() > result_size_) {
+    std::partial_sort(items.begin(), items.begin() + result_size_,
+                      items.end(), greater_pair<VectorId, double>);
+    items.resize(result_size_);
+  } else {
+    std::sort(items.begin(), items.end(), greater_pair<VectorId, double>);
+  }
+  if (cache_) cache_->insert(vec, max, items);
+}
+
+/**
+ * Enter the current epoch.
+ */
+size_t ClassifierHandle::enter() const {
+  size_t *readers = const_cast<size_t *>(readers_);
+  while (true) {
+    size_t epoch = epoch_;
+    __sync_fetch_and_add(&readers[epoch & 1], 1);
+    if (epoch == epoch_) return epoch;
+    // a writer has moved the epoch forward
+    __sync_fetch_and_sub(&readers[epoch & 1], 1);
+  }
+}
+
+/**
+ * Leave an epoch.
+ */
+void ClassifierHandle::leave(size_t epoch) const {
+  size_t *readers = const_cast<size_t *>(readers_);
+  __sync_fetch_and_sub(&readers[epoch & 1], 1);
+}
+
+/**
+ * Replace the current classifier.
+ */
+void ClassifierHandle::publish(Classifier *classifier) {
+  while (__sync_lock_test_and_set(&writer_lock_, 1)) sched_yield();
+
+  Classifier *old = current_;
+  size_t epoch = epoch_;
+  current_ = classifier;
+  __sync_synchronize();
+  epoch_ = epoch + 1;
+  __sync_synchronize();
+  // readers of the old epoch may still use the old classifier
+  while (readers_[epoch & 1] > 0) sched_yield();
+  if (old) delete old;
+
+  __sync_lock_release(&writer_lock_);
 }
 
 }  /* namespace bayon */
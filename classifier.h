@@ -27,6 +27,9 @@
 #include <utility>
 #include <vector>
 #include "byvector.h"
+#include "cache.h"
+#include "hnsw.h"
+#include "postings.h"
 
 namespace bayon {
 
@@ -35,27 +38,83 @@ namespace bayon {
  */
 class Classifier {
  public:
+  /**
+   * scoring methods of similar vectors
+   */
+  enum Scoring {
+    EXACT,       ///< calculate inner products of all candidates
+    ACCUMULATE,  ///< accumulate partial scores from inverted index
+    MAXSCORE,    ///< top-k retrieval with MaxScore dynamic pruning
+    DENSE,       ///< exact points with a dense feature-major matrix
+    HNSW,        ///< approximate search on a HNSW graph
+    TREE         ///< beam search on a cluster tree
+  };
+
   /** the identifier of a vector */
   typedef long VectorId;
+  /** the internal index of a vector */
+  typedef PostingList::PostingId VectorIndex;
   /** the items in inverted indexes */
-  typedef std::pair<VectorId, double> IndexItem;
+  typedef PostingList::Posting IndexItem;
   /** the value of inverted indexes */
-  typedef std::vector<IndexItem> InvertedIndexValue;
+  typedef PostingList InvertedIndexValue;
   /** inverted index */
   typedef HashMap<VecKey, InvertedIndexValue *>::type InvertedIndex;
 
+  /** default beam size of tree search */
+  static const size_t DEFAULT_BEAM_SIZE = 4;
+
  private:
-  static const VectorId VECID_EMPTY_KEY = -1;  ///< empty key
+  static const VectorId VECID_EMPTY_KEY = -1;    ///< empty key
+  static const VectorId VECID_DELETED_KEY = -2;  ///< deleted key
+  /** compact indexes when 1/COMPACTION_RATIO of them are removed */
+  static const size_t COMPACTION_RATIO = 4;
 
   HashMap<VectorId, Vector>::type vectors_;  ///< input vectors
+  std::vector<VectorId> ids_;                ///< identifiers of indexes
+  HashMap<VectorId, VectorIndex>::type indexes_;  ///< indexes of vectors
+  std::vector<bool> removed_;                ///< tombstones of indexes
+  size_t nremoved_;                          ///< the number of tombstones
   InvertedIndex inverted_index_;             ///< inverted index
+  size_t index_size_;                        ///< max size of posting lists
+  Scoring scoring_;                          ///< scoring method
+  size_t rescore_size_;                      ///< size of exact rescoring
+  size_t result_size_;                       ///< max size of results
+  HashMap<VecKey, size_t>::type dense_rows_;  ///< rows of dense matrix
+  std::vector<double> dense_matrix_;          ///< dense feature-major matrix
+  size_t dense_stride_;                       ///< row size of dense matrix
+  size_t dense_size_;                         ///< vectors in dense matrix
+  HnswIndex hnsw_;                            ///< HNSW graph
+  HashMap<VectorId, Vector>::type tree_vectors_;  ///< internal tree nodes
+  HashMap<VectorId, std::vector<VectorId> >::type tree_children_;
+                                              ///< children of tree nodes
+  VectorId tree_root_;                        ///< root of the tree
+  size_t beam_size_;                          ///< beam size of tree search
+  QueryCache *cache_;                         ///< cache of results
+
+  /**
+   * Remove cached results after the vectors or parameters change.
+   */
+  void clear_cache() {
+    if (cache_) cache_->clear();
+  }
+
+  /**
+   * Copy constructor (disabled).
+   */
+  Classifier(const Classifier &classifier);
+
+  /**
+   * Assignment operator (disabled).
+   */
+  Classifier &operator=(const Classifier &classifier);
 
   /**
    * Add vector keys to inverted index.
-   * @param id the identifier of a vector
+   * @param index the internal index of a vector
    * @param vec a feature vector
    */
-  void update_inverted_index(VectorId id, const Vector &vec);
+  void update_inverted_index(VectorIndex index, const Vector &vec);
 
   /**
    * Look up inverted index.
@@ -68,13 +127,75 @@ class Classifier {
   size_t lookup_inverted_index(size_t max, const Vector &vec,
                                std::vector<VectorId> &ids) const;
 
+  /**
+   * Accumulate partial inner products from inverted index.
+   * @param max the maximum number of keys of each vector
+   *            to be looked up in inverted index (0: all keys)
+   * @param vec a feature vector (must be normalized)
+   * @param items pairs of the identifiers and accumulated points
+   */
+  void accumulate_inverted_index(
+    size_t max, const Vector &vec,
+    std::vector<std::pair<VectorId, double> > &items) const;
+
+  /**
+   * Search similar vectors by beam search on the cluster tree.
+   * @param vec a feature vector (must be normalized)
+   * @param items pairs of the identifiers and similarity points
+   */
+  void search_tree(
+    const Vector &vec,
+    std::vector<std::pair<VectorId, double> > &items) const;
+
+  /**
+   * Search similar vectors on the HNSW graph and calculate exact points.
+   * @param vec a feature vector (must be normalized)
+   * @param items pairs of the identifiers and similarity points
+   */
+  void search_hnsw_index(
+    const Vector &vec,
+    std::vector<std::pair<VectorId, double> > &items) const;
+
+  /**
+   * Get the top similar vectors with MaxScore dynamic pruning.
+   * @param max the maximum number of keys of each vector
+   *            to be looked up in inverted index (0: all keys)
+   * @param vec a feature vector (must be normalized)
+   * @param items pairs of the identifiers and similarity points
+   */
+  void maxscore_inverted_index(
+    size_t max, const Vector &vec,
+    std::vector<std::pair<VectorId, double> > &items) const;
+
+  /**
+   * Calculate exact points with the dense feature-major matrix.
+   * @param vec a feature vector (must be normalized)
+   * @param items pairs of the identifiers and similarity points
+   */
+  void dense_inner_products(
+    const Vector &vec,
+    std::vector<std::pair<VectorId, double> > &items) const;
+
  public:
   /**
    * Constructor.
    */
-  Classifier() {
+  Classifier() : nremoved_(0), index_size_(0), scoring_(EXACT),
+                 rescore_size_(0), result_size_(0),
+                 dense_stride_(0), dense_size_(0),
+                 tree_root_(VECID_EMPTY_KEY), beam_size_(DEFAULT_BEAM_SIZE),
+                 cache_(NULL) {
     init_hash_map(VECID_EMPTY_KEY, vectors_);
+    init_hash_map(VECID_EMPTY_KEY, indexes_);
     init_hash_map(VECID_EMPTY_KEY, inverted_index_);
+    init_hash_map(VECTOR_EMPTY_KEY, dense_rows_);
+    init_hash_map(VECID_EMPTY_KEY, tree_vectors_);
+    init_hash_map(VECID_EMPTY_KEY, tree_children_);
+#ifdef HAVE_GOOGLE_DENSE_HASH_MAP
+    vectors_.set_deleted_key(VECID_DELETED_KEY);
+    indexes_.set_deleted_key(VECID_DELETED_KEY);
+    inverted_index_.set_deleted_key(VECTOR_DELETED_KEY);
+#endif
   }
 
   /**
@@ -85,19 +206,42 @@ class Classifier {
          it != inverted_index_.end(); ++it) {
       if (it->second) delete it->second;
     }
+    if (cache_) delete cache_;
   }
 
   /**
    * Add a vector.
+   * If the identifier already exists, the vector is replaced.
    * @param id the identifier of a vector
    * @param vec a feature vector
    */
-  void add_vector(VectorId id, const Vector &vec) {
-    vectors_[id] = vec;
-    vectors_[id].normalize();
-    update_inverted_index(id, vec);
+  void add_vector(VectorId id, const Vector &vec);
+
+  /**
+   * Replace a vector.
+   * @param id the identifier of a vector
+   * @param vec a new feature vector
+   */
+  void update_vector(VectorId id, const Vector &vec) {
+    add_vector(id, vec);
   }
 
+  /**
+   * Remove a vector.
+   * Postings of the vector are left as tombstones until compaction.
+   * @param id the identifier of a vector
+   * @return true if the vector existed
+   */
+  bool remove_vector(VectorId id);
+
+  /**
+   * Rebuild posting lists without tombstones and renumber internal indexes.
+   * This is called automatically when many vectors are removed.
+   * A HNSW graph is rebuilt with the remaining vectors,
+   * and a dense matrix must be built again after compaction.
+   */
+  void compact();
+
   /**
    * Get the number of vectors.
    * @return the number of vectors
@@ -107,11 +251,131 @@ class Classifier {
   }
 
   /**
-   * Resize a inverted index.
-   * @param the size of resized index
+   * Set a scoring method.
+   * @param scoring a scoring method
+   */
+  void set_scoring(Scoring scoring) {
+    scoring_ = scoring;
+    clear_cache();
+  }
+
+  /**
+   * Set the number of candidates whose accumulated points are
+   * replaced with exact inner products (ACCUMULATE only).
+   * @param siz the number of rescored candidates (0: no rescoring)
+   */
+  void set_rescore_size(size_t siz) {
+    rescore_size_ = siz;
+    clear_cache();
+  }
+
+  /**
+   * Set the maximum number of output similar vectors.
+   * MAXSCORE skips the vectors which cannot enter the results.
+   * @param siz the maximum number of results (0: all)
+   */
+  void set_result_size(size_t siz) {
+    result_size_ = siz;
+    clear_cache();
+  }
+
+  /**
+   * Resize a inverted index and compress posting lists.
+   * Vectors added later keep only the postings with the largest
+   * absolute weights in each list.
+   * @param siz the size of resized index
    */
   void resize_inverted_index(size_t siz);
 
+  /**
+   * Build a dense feature-major matrix of all vectors for DENSE scoring.
+   * The matrix has a row for each key of the vectors and needs
+   * (the number of keys) * (the number of vectors) * 8 bytes.
+   * DENSE scoring compares all vectors directly until this is called.
+   */
+  void build_dense_matrix();
+
+  /**
+   * Build a HNSW graph of all vectors for HNSW scoring.
+   * Vectors added later are inserted into the graph.
+   * @param max_links the maximum number of links of a node (M)
+   * @param ef_construction the size of candidates in construction
+   */
+  void build_hnsw_index(size_t max_links, size_t ef_construction);
+
+  /**
+   * Set the size of candidates in HNSW search (ef).
+   * HNSW scoring outputs at most the result size,
+   * or ef vectors if the result size is 0.
+   * @param ef the size of candidates
+   */
+  void set_hnsw_ef(size_t ef) {
+    hnsw_.set_ef(ef);
+    clear_cache();
+  }
+
+  /**
+   * Save the HNSW graph.
+   * @param os output stream
+   */
+  void save_hnsw_index(std::ostream &os) const {
+    hnsw_.save(os);
+  }
+
+  /**
+   * Load a HNSW graph saved for the same vectors.
+   * All vectors in the graph must be added before loading.
+   * @param is input stream
+   * @return true if the graph is loaded
+   */
+  bool load_hnsw_index(std::istream &is);
+
+  /**
+   * Add an internal node of a cluster tree for TREE scoring.
+   * The identifiers of nodes must differ from those of vectors.
+   * @param id the identifier of a node
+   * @param parent the identifier of the parent node (negative: root)
+   * @param vec the centroid vector of a node
+   */
+  void add_tree_node(VectorId id, VectorId parent, const Vector &vec);
+
+  /**
+   * Add a leaf of a cluster tree for TREE scoring.
+   * @param id the identifier of a vector
+   * @param parent the identifier of the parent node (negative: root)
+   */
+  void add_tree_leaf(VectorId id, VectorId parent);
+
+  /**
+   * Set the beam size of tree search.
+   * The children of beam size nodes are compared on each level.
+   * @param siz the beam size
+   */
+  void set_beam_size(size_t siz) {
+    beam_size_ = siz > 0 ? siz : 1;
+    clear_cache();
+  }
+
+  /**
+   * Set the memory budget of the cache of similar vectors.
+   * Queries with the same largest items share the cached results,
+   * and the least recently used results are removed over the budget.
+   * The cache is cleared whenever vectors or parameters change.
+   * @param siz the memory budget in bytes (0: no cache)
+   */
+  void set_cache_memory(size_t siz) {
+    if (cache_) delete cache_;
+    cache_ = siz > 0 ? new QueryCache(siz) : NULL;
+  }
+
+  /**
+   * Get the cache of similar vectors.
+   * @return the cache (NULL if no cache)
+   */
+  const QueryCache *cache() const {
+    return cache_;
+  }
+
   /**
    * Get the pairs of the identifiers and points of similar vectors.
    * @param max the maximum number of keys of each vector
@@ -124,6 +388,123 @@ class Classifier {
     std::vector<std::pair<VectorId, double> > &items) const;
 };
 
+
+/**
+ * ClassifierHandle class.
+ * Readers get a snapshot of the current classifier without locks,
+ * and a writer replaces it with a new one at any time.
+ * Readers are counted for each parity of an epoch and a writer
+ * deletes the old classifier after the readers of the old epoch leave.
+ */
+class ClassifierHandle {
+ private:
+  Classifier *current_;           ///< the current classifier
+  volatile size_t epoch_;         ///< the current epoch
+  volatile size_t readers_[2];    ///< the number of readers of each parity
+  volatile int writer_lock_;      ///< lock for writers
+
+  /**
+   * Enter the current epoch.
+   * @return the entered epoch
+   */
+  size_t enter() const;
+
+  /**
+   * Leave an epoch.
+   * @param epoch the epoch returned by enter()
+   */
+  void leave(size_t epoch) const;
+
+  /**
+   * Copy constructor (disabled).
+   */
+  ClassifierHandle(const ClassifierHandle &handle);
+
+  /**
+   * Assignment operator (disabled).
+   */
+  ClassifierHandle &operator=(const ClassifierHandle &handle);
+
+ public:
+  /**
+   * Snapshot class.
+   * A classifier is valid while its snapshot exists.
+   */
+  class Snapshot {
+   private:
+    const ClassifierHandle *handle_;  ///< a handle
+    size_t epoch_;                    ///< the entered epoch
+    const Classifier *classifier_;    ///< the classifier
+
+    /**
+     * Copy constructor (disabled).
+     */
+    Snapshot(const Snapshot &snapshot);
+
+    /**
+     * Assignment operator (disabled).
+     */
+    Snapshot &operator=(const Snapshot &snapshot);
+
+   public:
+    /**
+     * Constructor.
+     * @param handle a handle
+     */
+    explicit Snapshot(const ClassifierHandle &handle)
+      : handle_(&handle), epoch_(handle.enter()) {
+      classifier_ = handle.current_;
+    }
+
+    /**
+     * Destructor.
+     */
+    ~Snapshot() {
+      handle_->leave(epoch_);
+    }
+
+    /**
+     * Get the classifier.
+     * @return the classifier (NULL if nothing is published)
+     */
+    const Classifier *get() const {
+      return classifier_;
+    }
+
+    /**
+     * Access members of the classifier.
+     * @return the classifier
+     */
+    const Classifier *operator->() const {
+      return classifier_;
+    }
+  };
+
+  /**
+   * Constructor.
+   * @param classifier an initial classifier (owned by the handle)
+   */
+  explicit ClassifierHandle(Classifier *classifier = NULL)
+    : current_(classifier), epoch_(0), writer_lock_(0) {
+    readers_[0] = readers_[1] = 0;
+  }
+
+  /**
+   * Destructor.
+   * No snapshot may exist.
+   */
+  ~ClassifierHandle() {
+    if (current_) delete current_;
+  }
+
+  /**
+   * Replace the current classifier.
+   * This waits until no reader uses the old classifier and deletes it.
+   * @param classifier a new classifier (owned by the handle)
+   */
+  void publish(Classifier *classifier);
+};
+
 } /* namespace bayon */
 
 #endif  // BAYON_CLASSIFIER_H_
@@ -19,6 +19,8 @@
 
 #include <ctime>
 #include <map>
+#include <pthread.h>
+#include <sstream>
 #include <gtest/gtest.h>
 #include "classifier.h"
 
@@ -66,6 +68,515 @@ TEST(ClassifierTest, SimilarVectorsTest) {
   }
 }
 
+TEST(ClassifierTest, AccumulateTest) {
+  bayon::Classifier classifier;
+  size_t max = 10;
+  for (size_t i = 0; i < max; i++) {
+    bayon::Vector vec;
+    for (size_t j = 0; j < NUM_VECTOR_ITEM; j++) {
+      vec.set(rand() % (NUM_VECTOR_ITEM * 2), rand() % 10 + 1);
+    }
+    classifier.add_vector(i, vec);
+  }
+
+  bayon::Vector vec;
+  for (size_t i = 0; i < NUM_VECTOR_ITEM; i++) {
+    vec.set(rand() % (NUM_VECTOR_ITEM * 2), rand() % 10 + 1);
+  }
+  vec.normalize();
+
+  std::vector<std::pair<bayon::Classifier::VectorId, double> > exact, accum;
+  classifier.similar_vectors(0, vec, exact);
+  classifier.set_scoring(bayon::Classifier::ACCUMULATE);
+  classifier.similar_vectors(0, vec, accum);
+  EXPECT_EQ(exact.size(), accum.size());
+  std::map<bayon::Classifier::VectorId, double> points;
+  for (size_t i = 0; i < exact.size(); i++) {
+    points[exact[i].first] = exact[i].second;
+  }
+  for (size_t i = 0; i < accum.size(); i++) {
+    EXPECT_TRUE(points.find(accum[i].first) != points.end());
+    EXPECT_NEAR(points[accum[i].first], accum[i].second, 1e-9);
+  }
+
+  size_t rescore = 3;
+  std::vector<std::pair<bayon::Classifier::VectorId, double> > rescored;
+  classifier.set_rescore_size(rescore);
+  classifier.similar_vectors(1, vec, rescored);
+  EXPECT_TRUE(rescored.size() <= rescore);
+  for (size_t i = 0; i < rescored.size(); i++) {
+    EXPECT_NEAR(points[rescored[i].first], rescored[i].second, 1e-9);
+  }
+}
+
+TEST(ClassifierTest, MaxScoreTest) {
+  bayon::Classifier classifier;
+  size_t max = 200;
+  size_t max_key = 50;
+  for (size_t i = 0; i < max; i++) {
+    bayon::Vector vec;
+    for (size_t j = 0; j < NUM_VECTOR_ITEM * 2; j++) {
+      vec.set(rand() % max_key, rand() % 21 - 5);
+    }
+    classifier.add_vector(i, vec);
+  }
+  classifier.resize_inverted_index(max / 4);
+
+  for (size_t k = 1; k <= 20; k += 4) {
+    bayon::Vector vec;
+    for (size_t i = 0; i < NUM_VECTOR_ITEM * 2; i++) {
+      vec.set(rand() % max_key, rand() % 10 + 1);
+    }
+    vec.normalize();
+
+    std::vector<std::pair<bayon::Classifier::VectorId, double> > accum, top;
+    classifier.set_result_size(k);
+    classifier.set_scoring(bayon::Classifier::ACCUMULATE);
+    classifier.similar_vectors(NUM_VECTOR_ITEM, vec, accum);
+    classifier.set_scoring(bayon::Classifier::MAXSCORE);
+    classifier.similar_vectors(NUM_VECTOR_ITEM, vec, top);
+    EXPECT_EQ(accum.size(), top.size());
+    for (size_t i = 0; i < accum.size() && i < top.size(); i++) {
+      EXPECT_NEAR(accum[i].second, top[i].second, 1e-9);
+    }
+  }
+}
+
+TEST(ClassifierTest, DenseTest) {
+  bayon::Classifier classifier;
+  size_t max = 30;
+  size_t max_key = 50;
+  for (size_t i = 0; i < max; i++) {
+    bayon::Vector vec;
+    for (size_t j = 0; j < NUM_VECTOR_ITEM * 2; j++) {
+      vec.set(rand() % max_key, rand() % 21 - 5);
+    }
+    classifier.add_vector(i, vec);
+  }
+  classifier.build_dense_matrix();
+
+  bayon::Vector vec;
+  for (size_t i = 0; i < NUM_VECTOR_ITEM * 2; i++) {
+    vec.set(rand() % (max_key * 2), rand() % 10 + 1);
+  }
+  vec.normalize();
+
+  std::vector<std::pair<bayon::Classifier::VectorId, double> > exact, dense;
+  classifier.similar_vectors(0, vec, exact);
+  classifier.set_scoring(bayon::Classifier::DENSE);
+  classifier.similar_vectors(0, vec, dense);
+  EXPECT_EQ(exact.size(), dense.size());
+  std::map<bayon::Classifier::VectorId, double> points;
+  for (size_t i = 0; i < exact.size(); i++) {
+    points[exact[i].first] = exact[i].second;
+  }
+  for (size_t i = 0; i < dense.size(); i++) {
+    EXPECT_TRUE(points.find(dense[i].first) != points.end());
+    EXPECT_NEAR(points[dense[i].first], dense[i].second, 1e-9);
+  }
+}
+
+TEST(ClassifierTest, RemoveVectorTest) {
+  bayon::Classifier classifier, expected;
+  size_t max = 40;
+  size_t max_key = 30;
+  std::vector<bayon::Vector> vecs(max);
+  for (size_t i = 0; i < max; i++) {
+    for (size_t j = 0; j < NUM_VECTOR_ITEM; j++) {
+      vecs[i].set(rand() % max_key, rand() % 10 + 1);
+    }
+    classifier.add_vector(i, vecs[i]);
+  }
+  EXPECT_TRUE(classifier.remove_vector(3));
+  EXPECT_FALSE(classifier.remove_vector(3));
+  EXPECT_FALSE(classifier.remove_vector(max));
+  classifier.update_vector(5, vecs[6]);
+  for (size_t i = 0; i < max; i++) {
+    if (i == 3) continue;
+    expected.add_vector(i, i == 5 ? vecs[6] : vecs[i]);
+  }
+  EXPECT_EQ(expected.count_vectors(), classifier.count_vectors());
+
+  bayon::Vector vec;
+  for (size_t i = 0; i < NUM_VECTOR_ITEM; i++) {
+    vec.set(rand() % max_key, rand() % 10 + 1);
+  }
+  vec.normalize();
+
+  bayon::Classifier::Scoring methods[] = {
+    bayon::Classifier::EXACT, bayon::Classifier::ACCUMULATE,
+    bayon::Classifier::MAXSCORE
+  };
+  for (size_t round = 0; round < 2; round++) {
+    for (size_t m = 0; m < sizeof(methods) / sizeof(methods[0]); m++) {
+      std::vector<std::pair<bayon::Classifier::VectorId, double> > items, ans;
+      classifier.set_scoring(methods[m]);
+      expected.set_scoring(methods[m]);
+      classifier.similar_vectors(0, vec, items);
+      expected.similar_vectors(0, vec, ans);
+      EXPECT_EQ(ans.size(), items.size());
+      std::map<bayon::Classifier::VectorId, double> points;
+      for (size_t i = 0; i < ans.size(); i++) {
+        points[ans[i].first] = ans[i].second;
+      }
+      for (size_t i = 0; i < items.size(); i++) {
+        EXPECT_TRUE(points.find(items[i].first) != points.end());
+        EXPECT_NEAR(points[items[i].first], items[i].second, 1e-9);
+      }
+    }
+    /* removing a half of vectors triggers compaction */
+    for (size_t i = 0; i < max; i += 2) {
+      classifier.remove_vector(i);
+      expected.remove_vector(i);
+    }
+    EXPECT_EQ(expected.count_vectors(), classifier.count_vectors());
+  }
+}
+
+TEST(ClassifierTest, BoundedIndexTest) {
+  bayon::Classifier classifier;
+  size_t siz = 5;
+  classifier.resize_inverted_index(siz);
+  for (size_t i = 0; i < 20; i++) {
+    bayon::Vector vec;
+    vec.set(0, i + 1);
+    vec.set(1, 20);
+    classifier.add_vector(i, vec);
+  }
+  /* only vectors with the largest weights of key 0 are indexed */
+  bayon::Vector vec;
+  vec.set(0, 1.0);
+  std::vector<std::pair<bayon::Classifier::VectorId, double> > items;
+  classifier.similar_vectors(1, vec, items);
+  EXPECT_EQ(siz, items.size());
+  for (size_t i = 0; i < items.size(); i++) {
+    EXPECT_TRUE(items[i].first >= 15);
+  }
+
+  /* removed vectors do not keep their postings */
+  classifier.remove_vector(19);
+  bayon::Vector small;
+  small.set(0, 1);
+  small.set(1, 100);
+  classifier.add_vector(20, small);
+  items.clear();
+  classifier.similar_vectors(1, vec, items);
+  EXPECT_EQ(siz, items.size());
+  bool found = false;
+  for (size_t i = 0; i < items.size(); i++) {
+    if (items[i].first == 20) found = true;
+  }
+  EXPECT_TRUE(found);
+}
+
+TEST(ClassifierTest, HnswTest) {
+  bayon::Classifier classifier;
+  size_t max = 500;
+  size_t max_key = 100;
+  std::vector<bayon::Vector> vecs(max);
+  for (size_t i = 0; i < max; i++) {
+    for (size_t j = 0; j < NUM_VECTOR_ITEM * 2; j++) {
+      vecs[i].set(rand() % max_key, rand() % 10 + 1);
+    }
+    classifier.add_vector(i, vecs[i]);
+  }
+  classifier.build_hnsw_index(8, 100);
+  classifier.set_hnsw_ef(100);
+  size_t k = 10;
+  classifier.set_result_size(k);
+
+  std::vector<bayon::Vector> queries(20);
+  size_t nfound = 0;
+  for (size_t q = 0; q < queries.size(); q++) {
+    for (size_t i = 0; i < NUM_VECTOR_ITEM * 2; i++) {
+      queries[q].set(rand() % max_key, rand() % 10 + 1);
+    }
+    queries[q].normalize();
+    std::vector<std::pair<bayon::Classifier::VectorId, double> > exact, hnsw;
+    classifier.set_scoring(bayon::Classifier::EXACT);
+    classifier.similar_vectors(0, queries[q], exact);
+    classifier.set_scoring(bayon::Classifier::HNSW);
+    classifier.similar_vectors(0, queries[q], hnsw);
+    EXPECT_TRUE(hnsw.size() <= k);
+    for (size_t i = 0; i < hnsw.size(); i++) {
+      for (size_t j = 0; j < exact.size(); j++) {
+        if (hnsw[i].first == exact[j].first) {
+          EXPECT_NEAR(exact[j].second, hnsw[i].second, 1e-9);
+          nfound++;
+        }
+      }
+    }
+  }
+  /* recall of top-k vectors */
+  EXPECT_TRUE(nfound >= queries.size() * k * 9 / 10);
+
+  /* save and load */
+  std::stringstream ss;
+  classifier.save_hnsw_index(ss);
+  bayon::Classifier loaded, empty;
+  for (size_t i = 0; i < max; i++) loaded.add_vector(i, vecs[i]);
+  std::stringstream broken("1\t2\n"), copied(ss.str());
+  EXPECT_FALSE(loaded.load_hnsw_index(broken));
+  EXPECT_FALSE(empty.load_hnsw_index(copied));
+  EXPECT_TRUE(loaded.load_hnsw_index(ss));
+  loaded.set_scoring(bayon::Classifier::HNSW);
+  loaded.set_hnsw_ef(100);
+  loaded.set_result_size(k);
+  std::vector<std::pair<bayon::Classifier::VectorId, double> > items, ans;
+  classifier.similar_vectors(0, queries[0], ans);
+  loaded.similar_vectors(0, queries[0], items);
+  EXPECT_EQ(ans.size(), items.size());
+  for (size_t i = 0; i < ans.size() && i < items.size(); i++) {
+    EXPECT_NEAR(ans[i].second, items[i].second, 1e-9);
+  }
+
+  /* removed vectors are skipped */
+  ASSERT_FALSE(ans.empty());
+  loaded.remove_vector(ans[0].first);
+  items.clear();
+  loaded.similar_vectors(0, queries[0], items);
+  for (size_t i = 0; i < items.size(); i++) {
+    EXPECT_NE(ans[0].first, items[i].first);
+  }
+
+  /* compaction rebuilds the graph with the remaining vectors */
+  bayon::Classifier rest;
+  for (size_t i = 0; i < max; i += 2) {
+    classifier.remove_vector(i + 1);
+    rest.add_vector(i, vecs[i]);
+  }
+  classifier.compact();
+  std::stringstream compacted;
+  classifier.save_hnsw_index(compacted);
+  EXPECT_TRUE(rest.load_hnsw_index(compacted));
+  items.clear();
+  classifier.similar_vectors(0, queries[0], items);
+  EXPECT_EQ(k, items.size());
+  for (size_t i = 0; i < items.size(); i++) {
+    EXPECT_EQ(0, items[i].first % 2);
+  }
+}
+
+TEST(ClassifierTest, TreeTest) {
+  bayon::Classifier classifier;
+  /* root(100) -> node(101), node(102) -> leaves 0, 1 and 2, 3 */
+  bayon::Vector vecs[4], left, right, root;
+  vecs[0].set(0, 1.0);
+  vecs[1].set(0, 1.0);
+  vecs[1].set(1, 0.5);
+  vecs[2].set(2, 1.0);
+  vecs[3].set(2, 1.0);
+  vecs[3].set(3, 0.5);
+  for (size_t i = 0; i < 4; i++) classifier.add_vector(i, vecs[i]);
+  left.set(0, 1.0);
+  right.set(2, 1.0);
+  root.set(0, 1.0);
+  root.set(2, 1.0);
+  classifier.add_tree_node(100, -1, root);
+  classifier.add_tree_node(101, 100, left);
+  classifier.add_tree_node(102, 100, right);
+  classifier.add_tree_leaf(0, 101);
+  classifier.add_tree_leaf(1, 101);
+  classifier.add_tree_leaf(2, 102);
+  classifier.add_tree_leaf(3, 102);
+  classifier.set_scoring(bayon::Classifier::TREE);
+  classifier.set_beam_size(1);
+
+  bayon::Vector vec;
+  vec.set(2, 1.0);
+  vec.set(3, 0.2);
+  vec.set(0, 0.1);
+  vec.normalize();
+  std::vector<std::pair<bayon::Classifier::VectorId, double> > items, exact;
+  classifier.similar_vectors(0, vec, items);
+  EXPECT_EQ(static_cast<size_t>(2), items.size());
+  for (size_t i = 0; i < items.size(); i++) {
+    EXPECT_TRUE(items[i].first == 2 || items[i].first == 3);
+  }
+
+  /* all leaves are compared with a large beam */
+  classifier.set_beam_size(2);
+  items.clear();
+  classifier.similar_vectors(0, vec, items);
+  classifier.set_scoring(bayon::Classifier::EXACT);
+  classifier.similar_vectors(0, vec, exact);
+  EXPECT_EQ(exact.size(), items.size());
+  for (size_t i = 0; i < exact.size() && i < items.size(); i++) {
+    EXPECT_NEAR(exact[i].second, items[i].second, 1e-9);
+  }
+}
+
+TEST(ClassifierTest, CacheTest) {
+  bayon::Classifier classifier;
+  for (size_t i = 0; i < 20; i++) {
+    bayon::Vector vec;
+    vec.set(i % 5, 1.0);
+    vec.set(i + 10, 0.5);
+    classifier.add_vector(i, vec);
+  }
+  classifier.set_cache_memory(1024 * 1024);
+
+  bayon::Vector vec;
+  vec.set(1, 1.0);
+  vec.set(12, 0.5);
+  vec.normalize();
+  std::vector<std::pair<bayon::Classifier::VectorId, double> > first, second;
+  classifier.similar_vectors(0, vec, first);
+  classifier.similar_vectors(0, vec, second);
+  EXPECT_EQ(classifier.cache()->misses(), 1U);
+  EXPECT_EQ(classifier.cache()->hits(), 1U);
+  EXPECT_EQ(first, second);
+
+  // near-identical queries share the results
+  bayon::Vector near;
+  near.set(1, 1.0);
+  near.set(12, 0.5000001);
+  near.normalize();
+  second.clear();
+  classifier.similar_vectors(0, near, second);
+  EXPECT_EQ(classifier.cache()->hits(), 2U);
+  EXPECT_EQ(first, second);
+
+  // a different parameter is another query
+  second.clear();
+  classifier.similar_vectors(1, vec, second);
+  EXPECT_EQ(classifier.cache()->misses(), 2U);
+
+  // added vectors clear the cache
+  bayon::Vector added;
+  added.set(1, 1.0);
+  added.set(12, 0.5);
+  classifier.add_vector(100, added);
+  EXPECT_EQ(classifier.cache()->size(), 0U);
+  second.clear();
+  classifier.similar_vectors(0, vec, second);
+  EXPECT_EQ(classifier.cache()->misses(), 3U);
+  ASSERT_FALSE(second.empty());
+  EXPECT_EQ(second[0].first, 100);
+}
+
+TEST(QueryCacheTest, EvictionTest) {
+  bayon::QueryCache::Result result(1, 0.5);
+  std::vector<bayon::QueryCache::Result> results(10, result);
+  bayon::QueryCache probe(1024 * 1024);
+  bayon::Vector vec;
+  vec.set(0, 1.0);
+  probe.insert(vec, 0, results);
+  size_t entry_size = probe.memory_size();
+
+  bayon::QueryCache cache(entry_size * 3);
+  for (size_t i = 0; i < 3; i++) {
+    bayon::Vector query;
+    query.set(i, 1.0);
+    cache.insert(query, 0, results);
+  }
+  EXPECT_EQ(cache.size(), 3U);
+
+  // use the first query and insert a new one
+  std::vector<bayon::QueryCache::Result> found;
+  bayon::Vector query;
+  query.set(0, 1.0);
+  EXPECT_TRUE(cache.lookup(query, 0, found));
+  EXPECT_EQ(found, results);
+  query.clear();
+  query.set(3, 1.0);
+  cache.insert(query, 0, results);
+  EXPECT_EQ(cache.size(), 3U);
+  EXPECT_LE(cache.memory_size(), entry_size * 3);
+
+  // the least recently used query is removed
+  query.clear();
+  query.set(1, 1.0);
+  found.clear();
+  EXPECT_FALSE(cache.lookup(query, 0, found));
+  query.clear();
+  query.set(0, 1.0);
+  EXPECT_TRUE(cache.lookup(query, 0, found));
+  EXPECT_EQ(cache.hits(), 2U);
+  EXPECT_EQ(cache.misses(), 1U);
+
+  // an entry over the budget is not stored
+  bayon::QueryCache small(entry_size - 1);
+  small.insert(vec, 0, results);
+  EXPECT_EQ(small.size(), 0U);
+}
+
+const size_t NUM_GENERATION = 50;
+const size_t NUM_HANDLE_VECTOR = 10;
+
+bayon::Classifier *create_generation(size_t generation) {
+  bayon::Classifier *classifier = new bayon::Classifier;
+  for (size_t i = 0; i < NUM_HANDLE_VECTOR; i++) {
+    bayon::Vector vec;
+    vec.set(i % 3, i + 1);
+    vec.set(3, 1);
+    classifier->add_vector(generation * NUM_HANDLE_VECTOR + i, vec);
+  }
+  return classifier;
+}
+
+struct HandleReader {
+  bayon::ClassifierHandle *handle;
+  volatile bool *stop;
+  size_t errors;
+};
+
+void *read_handle(void *arg) {
+  HandleReader *reader = static_cast<HandleReader *>(arg);
+  bayon::Vector vec;
+  vec.set(3, 1);
+  while (!*reader->stop) {
+    bayon::ClassifierHandle::Snapshot snapshot(*reader->handle);
+    std::vector<std::pair<bayon::Classifier::VectorId, double> > items;
+    snapshot->similar_vectors(1, vec, items);
+    if (items.size() != NUM_HANDLE_VECTOR) reader->errors++;
+    for (size_t i = 1; i < items.size(); i++) {
+      if (items[i].first / NUM_HANDLE_VECTOR
+          != items[0].first / NUM_HANDLE_VECTOR) {
+        reader->errors++;
+      }
+    }
+  }
+  return NULL;
+}
+
+TEST(ClassifierHandleTest, PublishTest) {
+  bayon::ClassifierHandle empty;
+  {
+    bayon::ClassifierHandle::Snapshot snapshot(empty);
+    EXPECT_TRUE(snapshot.get() == NULL);
+  }
+
+  bayon::ClassifierHandle handle(create_generation(0));
+  volatile bool stop = false;
+  const size_t nthreads = 4;
+  HandleReader readers[nthreads];
+  pthread_t threads[nthreads];
+  for (size_t i = 0; i < nthreads; i++) {
+    readers[i].handle = &handle;
+    readers[i].stop = &stop;
+    readers[i].errors = 0;
+    pthread_create(&threads[i], NULL, read_handle, &readers[i]);
+  }
+  for (size_t i = 1; i < NUM_GENERATION; i++) {
+    handle.publish(create_generation(i));
+  }
+  stop = true;
+  for (size_t i = 0; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+    EXPECT_EQ(0U, readers[i].errors);
+  }
+
+  bayon::ClassifierHandle::Snapshot snapshot(handle);
+  std::vector<std::pair<bayon::Classifier::VectorId, double> > items;
+  bayon::Vector vec;
+  vec.set(3, 1);
+  snapshot->similar_vectors(1, vec, items);
+  EXPECT_EQ(NUM_HANDLE_VECTOR, items.size());
+  EXPECT_EQ(NUM_GENERATION - 1,
+            static_cast<size_t>(items[0].first) / NUM_HANDLE_VECTOR);
+}
+
 } /* namespace */
 
 int main(int argc, char **argv) {
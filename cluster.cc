@@ -109,6 +109,8 @@ void Cluster::choose_smartly(size_t ndocs, std::vector<Document *> &docs) {
 void Cluster::set_sectioned_gain() {
   double gain = 0.0;
   if (sectioned_gain_ == 0 && sectioned_clusters_.size() > 1) {
+    // the composite vector is cleared after a cluster is sectioned
+    if (documents_.size() > 0 && !composite_.size()) set_composite_vector();
     for (size_t i = 0; i < sectioned_clusters_.size(); i++) {
       gain += sectioned_clusters_[i]->composite_vector()->norm();
     }
@@ -127,7 +129,7 @@ void Cluster::section(size_t nclusters) {
   // choose_randomly(nclusters, centroids);
   choose_smartly(nclusters, centroids);
   for (size_t i = 0; i < centroids.size(); i++) {
-    Cluster *cluster = new Cluster();
+    Cluster *cluster = pool_ ? pool_->get() : new Cluster();
     cluster->set_seed(seed_);
     sectioned_clusters_.push_back(cluster);
   }
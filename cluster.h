@@ -30,6 +30,8 @@
 
 namespace bayon {
 
+class ClusterPool;
+
 /**
  * Cluster class.
  */
@@ -38,10 +40,13 @@ class Cluster {
   std::vector<Document *> documents_;          ///< documents
   Vector composite_;                           ///< a composite vector
   Vector centroid_;                            ///< a centroid vector
-  HashMap<DocumentId, bool>::type removed_;    ///< removed documents
+  std::vector<bool> removed_;                  ///< tombstones of documents
+  size_t nremoved_;                            ///< the number of tombstones
+  HashMap<DocumentId, size_t>::type positions_;  ///< indexes of documents
   std::vector<Cluster *> sectioned_clusters_;  ///< sectioned clusters
   double sectioned_gain_;                      ///< a sectioned gain
   unsigned int seed_;                          ///< seed
+  ClusterPool *pool_;                          ///< pool of sectioned clusters
 
   /**
    * Add the vectors of all documents to a composite vector.
@@ -58,19 +63,22 @@ class Cluster {
   /**
    * Constructor.
    */
-  Cluster() : sectioned_gain_(0), seed_(DEFAULT_SEED) {
-    init_hash_map(DOC_EMPTY_KEY, removed_);
+  Cluster() : nremoved_(0), sectioned_gain_(0), seed_(DEFAULT_SEED),
+              pool_(NULL) {
+    init_hash_map(DOC_EMPTY_KEY, positions_);
   }
 
   /**
    * Constructor.
    * @param n the bucket count of a composite vector
    */
-  Cluster(size_t n) : sectioned_gain_(0), seed_(DEFAULT_SEED) {
-    init_hash_map(DOC_EMPTY_KEY, removed_);
+  Cluster(size_t n) : nremoved_(0), sectioned_gain_(0), seed_(DEFAULT_SEED),
+                     pool_(NULL) {
+    init_hash_map(DOC_EMPTY_KEY, positions_);
     composite_.set_bucket_count(n);
     centroid_.set_bucket_count(n);
-    // removed_.resize(n);
+    documents_.reserve(n);
+    removed_.reserve(n);
   }
 
   /**
@@ -86,6 +94,8 @@ class Cluster {
     composite_.clear();
     centroid_.clear();
     removed_.clear();
+    nremoved_ = 0;
+    positions_.clear();
     sectioned_clusters_.clear();
     sectioned_gain_ = 0.0;
   }
@@ -99,12 +109,30 @@ class Cluster {
     mysrand(seed_);
   }
 
+  /**
+   * Get the current seed value for a random number generator.
+   * @return the seed value
+   */
+  unsigned int seed() const {
+    return seed_;
+  }
+
+  /**
+   * Set a pool of clusters, from which sectioned clusters are taken.
+   * Sectioned clusters are owned by the pool.
+   * @param pool a pool of clusters (NULL: sectioned clusters are allocated
+   *             and must be deleted by users)
+   */
+  void set_pool(ClusterPool *pool) {
+    pool_ = pool;
+  }
+
   /**
    * Get the size.
    * @return the size of this cluster
    */
   size_t size() const {
-    return documents_.size() - removed_.size();
+    return documents_.size() - nremoved_;
   }
 
   /**
@@ -128,6 +156,7 @@ class Cluster {
 
   /**
    * Get documents in this cluster.
+   * Removed documents remain until refresh() is called.
    * @return documents in this cluster
    */
   const std::vector<Document *> &documents() const  {
@@ -140,7 +169,9 @@ class Cluster {
    */
   void add_document(Document *doc) {
     doc->feature()->normalize();
+    if (!positions_.empty()) positions_[doc->id()] = documents_.size();
     documents_.push_back(doc);
+    removed_.push_back(false);
     composite_.add_vector(*doc->feature());
   }
 
@@ -149,8 +180,10 @@ class Cluster {
    * @param index the index of vector container of documents
    */
   void remove_document(size_t index) {
+    if (removed_[index]) return;
     composite_.delete_vector(*documents_[index]->feature());
-    removed_[documents_[index]->id()] = true;
+    removed_[index] = true;
+    nremoved_++;
   }
 
   /**
@@ -158,14 +191,49 @@ class Cluster {
    * @param doc the pointer of a document object
    */
   void remove_document(const Document *doc) {
+    // indexes are made at the first removal by documents
+    if (positions_.empty()) {
+      for (size_t i = 0; i < documents_.size(); i++) {
+        positions_[documents_[i]->id()] = i;
+      }
+    }
+    HashMap<DocumentId, size_t>::type::const_iterator it =
+      positions_.find(doc->id());
+    if (it == positions_.end()) return;
+    if (documents_[it->second] == doc) {
+      remove_document(it->second);
+      return;
+    }
+    // another document has the same identifier
     for (size_t i = 0; i < documents_.size(); i++) {
-      if (documents_[i]->id() == doc->id()) {
+      if (documents_[i] == doc) {
         remove_document(i);
         return;
       }
     }
   }
 
+  /**
+   * Replace documents of this cluster without updating the composite vector,
+   * which must be the sum of the new documents already.
+   * @param docs documents (swapped with current documents)
+   */
+  void set_documents(std::vector<Document *> &docs) {
+    documents_.swap(docs);
+    removed_.assign(documents_.size(), false);
+    nremoved_ = 0;
+    positions_.clear();
+  }
+
+  /**
+   * Check whether a document is removed.
+   * @param index the index of vector container of documents
+   * @return true if removed
+   */
+  bool removed(size_t index) const {
+    return removed_[index];
+  }
+
   /**
    * Get sorted documents in this clusters.
    * by similarity between documents and center (desc order)
@@ -177,15 +245,16 @@ class Cluster {
    * Delete removed documents from the internal container.
    */
   void refresh() {
-    if (removed_.size() > 0) {
-      std::vector<Document *> docs;
+    if (nremoved_ > 0) {
+      size_t n = 0;
       for (size_t i = 0; i < documents_.size(); i++) {
-        if (removed_.find(documents_[i]->id()) == removed_.end()) {
-          docs.push_back(documents_[i]);
-        }
+        documents_[n] = documents_[i];
+        n += !removed_[i];
       }
-      documents_ = docs;
-      removed_.clear();
+      documents_.resize(n);
+      removed_.assign(n, false);
+      nremoved_ = 0;
+      positions_.clear();
     }
   }
 
@@ -202,6 +271,15 @@ class Cluster {
    */
   void set_sectioned_gain();
 
+  /**
+   * Set a gain of the section, which is recalculated by
+   * set_sectioned_gain() only if it is zero.
+   * @param gain a sectioned gain
+   */
+  void set_sectioned_gain(double gain) {
+    sectioned_gain_ = gain;
+  }
+
   /**
    * Get sectioned clusters.
    * @return sectioned clusters
@@ -264,6 +342,84 @@ class Cluster {
   }
 };
 
+/**
+ * ClusterPool class.
+ * Clusters are allocated by a pool and released to it for reuse, which
+ * keeps their containers allocated. All clusters are deleted together
+ * with the pool.
+ */
+class ClusterPool {
+ private:
+  std::vector<Cluster *> clusters_;  ///< all clusters of this pool
+  std::vector<Cluster *> released_;  ///< clusters to be reused
+
+  /**
+   * Copy constructor (disabled).
+   */
+  ClusterPool(const ClusterPool &pool);
+
+  /**
+   * Assignment operator (disabled).
+   */
+  ClusterPool &operator=(const ClusterPool &pool);
+
+ public:
+  /**
+   * Constructor.
+   */
+  ClusterPool() { }
+
+  /**
+   * Destructor.
+   */
+  ~ClusterPool() {
+    for (size_t i = 0; i < clusters_.size(); i++) {
+      delete clusters_[i];
+    }
+  }
+
+  /**
+   * Get an empty cluster.
+   * @return the pointer of a cluster
+   */
+  Cluster *get() {
+    if (released_.empty()) {
+      Cluster *cluster = new Cluster();
+      cluster->set_pool(this);
+      clusters_.push_back(cluster);
+      return cluster;
+    }
+    Cluster *cluster = released_.back();
+    released_.pop_back();
+    cluster->clear();
+    return cluster;
+  }
+
+  /**
+   * Release a cluster to be reused (its sectioned clusters are not).
+   * @param cluster the pointer of a cluster taken from this pool
+   */
+  void release(Cluster *cluster) {
+    released_.push_back(cluster);
+  }
+
+  /**
+   * Get the number of clusters allocated by this pool.
+   * @return the number of clusters
+   */
+  size_t size() const {
+    return clusters_.size();
+  }
+
+  /**
+   * Get the number of released clusters.
+   * @return the number of released clusters
+   */
+  size_t released_size() const {
+    return released_.size();
+  }
+};
+
 /**
  * Compare clusters by sizes of clusters.
  * @param a  cluster
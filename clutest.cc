@@ -71,6 +71,78 @@ TEST(ClusterTest, SizeTest) {
   delete_documents(documents);
 }
 
+/* Cluster::remove_document, Cluster::refresh */
+TEST(ClusterTest, RemoveTest) {
+  std::vector<bayon::Document *> documents;
+  init_documents(documents);
+  bayon::Cluster cluster;
+  set_cluster(cluster, documents);
+
+  cluster.remove_document(static_cast<size_t>(1));
+  cluster.remove_document(documents[4]);
+  cluster.remove_document(documents[4]);  // already removed
+  EXPECT_EQ(cluster.size(), NUM_DOCUMENT - 2);
+  EXPECT_TRUE(cluster.removed(1));
+  EXPECT_TRUE(cluster.removed(4));
+  EXPECT_FALSE(cluster.removed(0));
+
+  bayon::Vector vec;
+  for (size_t i = 0; i < documents.size(); i++) {
+    if (i != 1 && i != 4) vec.add_vector(*documents[i]->feature());
+  }
+  bayon::Vector *compvec = cluster.composite_vector();
+  for (bayon::VecHashMap::iterator it = vec.hash_map()->begin();
+       it != vec.hash_map()->end(); ++it) {
+    EXPECT_NEAR(it->second, compvec->get(it->first), 1e-9);
+  }
+
+  cluster.refresh();
+  EXPECT_EQ(cluster.documents().size(), NUM_DOCUMENT - 2);
+  EXPECT_EQ(cluster.documents()[1]->id(), documents[2]->id());
+  EXPECT_EQ(cluster.documents()[3]->id(), documents[5]->id());
+  cluster.remove_document(documents[5]);
+  EXPECT_TRUE(cluster.removed(3));
+  EXPECT_EQ(cluster.size(), NUM_DOCUMENT - 3);
+  delete_documents(documents);
+}
+
+/* Cluster::remove_document with duplicate identifiers */
+TEST(ClusterTest, RemoveDuplicateIdTest) {
+  bayon::Document d1(1), d2(1), d3(1);
+  bayon::Cluster cluster;
+  cluster.add_document(&d1);
+  cluster.add_document(&d2);
+  cluster.add_document(&d3);
+  cluster.remove_document(&d1);
+  EXPECT_TRUE(cluster.removed(0));
+  EXPECT_FALSE(cluster.removed(1));
+  EXPECT_FALSE(cluster.removed(2));
+  cluster.remove_document(&d3);
+  EXPECT_TRUE(cluster.removed(2));
+  EXPECT_FALSE(cluster.removed(1));
+  EXPECT_EQ(cluster.size(), static_cast<size_t>(1));
+}
+
+/* Cluster::set_documents */
+TEST(ClusterTest, SetDocumentsTest) {
+  std::vector<bayon::Document *> documents;
+  init_documents(documents);
+  bayon::Cluster cluster;
+  set_cluster(cluster, documents);
+  cluster.remove_document(static_cast<size_t>(0));
+
+  std::vector<bayon::Document *> docs;
+  docs.push_back(documents[2]);
+  docs.push_back(documents[3]);
+  cluster.set_documents(docs);
+  EXPECT_EQ(cluster.size(), static_cast<size_t>(2));
+  EXPECT_EQ(cluster.documents()[0]->id(), documents[2]->id());
+  EXPECT_FALSE(cluster.removed(0));
+  cluster.remove_document(documents[3]);
+  EXPECT_TRUE(cluster.removed(1));
+  delete_documents(documents);
+}
+
 /* Cluster::composite_vector */
 TEST(ClusterTest, CompositeTest) {
   std::vector<bayon::Document *> documents;
@@ -188,6 +260,33 @@ TEST(ClusterTest, SectionTest) {
   delete_documents(documents);
 }
 
+/* ClusterPool */
+TEST(ClusterPoolTest, SectionTest) {
+  std::vector<bayon::Document *> documents;
+  init_documents(documents);
+  bayon::ClusterPool pool;
+  bayon::Cluster *cluster = pool.get();
+  set_cluster(*cluster, documents);
+  EXPECT_EQ(pool.size(), 1U);
+
+  // sectioned clusters are taken from the pool
+  cluster->section(2);
+  EXPECT_EQ(pool.size(), 3U);
+  bayon::Cluster *sectioned = cluster->sectioned_clusters()[0];
+  EXPECT_GT(sectioned->size(), 0U);
+
+  // a released cluster is reused after cleared
+  pool.release(sectioned);
+  EXPECT_EQ(pool.released_size(), 1U);
+  bayon::Cluster *reused = pool.get();
+  EXPECT_EQ(reused, sectioned);
+  EXPECT_EQ(reused->size(), 0U);
+  EXPECT_EQ(reused->composite_vector()->size(), 0U);
+  EXPECT_EQ(pool.released_size(), 0U);
+  EXPECT_EQ(pool.size(), 3U);
+  delete_documents(documents);
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   int result = RUN_ALL_TESTS();
@@ -25,6 +25,7 @@
 #endif
 
 #include "byvector.h"
+#include "sketch.h"
 
 namespace bayon {
 
@@ -129,6 +130,20 @@ class Document {
         it->second * log(static_cast<double>(ndocs) / denom);
     }
   }
+
+  /**
+   * Apply IDF weighting with estimated document frequencies.
+   * @param df a sketch of document frequencies
+   * @param ndocs the number of documents
+   */
+  void idf(const CountMinSketch &df, size_t ndocs) {
+    VecHashMap *hmap = feature()->hash_map();
+    for (VecHashMap::iterator it = hmap->begin(); it != hmap->end(); ++it) {
+      size_t denom = std::max(df.estimate(it->first), static_cast<size_t>(1));
+      (*hmap)[it->first] =
+        it->second * log(static_cast<double>(ndocs) / denom);
+    }
+  }
 };
 
 }  /* namespace bayon */
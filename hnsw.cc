@@ -0,0 +1,290 @@
+//
+// Hierarchical navigable small world graph
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <queue>
+#include <string>
+#include "hnsw.h"
+
+namespace {
+
+/**
+ * Order of points for a max-heap of candidates.
+ */
+struct LessPoint {
+  bool operator()(const bayon::HnswIndex::NodePoint &left,
+                  const bayon::HnswIndex::NodePoint &right) const {
+    return left.second < right.second;
+  }
+};
+
+/**
+ * Order of points for a min-heap of results.
+ */
+struct GreaterPoint {
+  bool operator()(const bayon::HnswIndex::NodePoint &left,
+                  const bayon::HnswIndex::NodePoint &right) const {
+    return left.second > right.second;
+  }
+};
+
+} /* namespace */
+
+namespace bayon {
+
+const size_t HnswIndex::DEFAULT_MAX_LINKS;
+const size_t HnswIndex::DEFAULT_EF_CONSTRUCTION;
+const size_t HnswIndex::DEFAULT_EF;
+
+/**
+ * Get the inner product of a vector and a node.
+ */
+double HnswIndex::similarity(const Vector &vec, const Node &node) {
+  double prod = 0.0;
+  const VecHashMap *hmap = vec.hash_map();
+  for (size_t i = 0; i < node.items.size(); i++) {
+    VecHashMap::const_iterator it = hmap->find(node.items[i].first);
+    if (it != hmap->end()) prod += it->second * node.items[i].second;
+  }
+  return prod;
+}
+
+/**
+ * Get the inner product of nodes.
+ */
+double HnswIndex::similarity(const Node &node1, const Node &node2) {
+  double prod = 0.0;
+  size_t i = 0, j = 0;
+  while (i < node1.items.size() && j < node2.items.size()) {
+    if (node1.items[i].first < node2.items[j].first) {
+      i++;
+    } else if (node2.items[j].first < node1.items[i].first) {
+      j++;
+    } else {
+      prod += node1.items[i++].second * node2.items[j++].second;
+    }
+  }
+  return prod;
+}
+
+/**
+ * Get a random level of a new node.
+ */
+size_t HnswIndex::random_level() {
+  double r = (myrand(&seed_) + 1.0) / (static_cast<double>(RAND_MAX) + 1.0);
+  return static_cast<size_t>(-log(r) / log(static_cast<double>(max_links_)));
+}
+
+/**
+ * Search the nearest nodes on a level.
+ */
+void HnswIndex::search_level(const Vector &vec,
+                             std::vector<NodePoint> &entries,
+                             size_t ef, size_t level) const {
+  HashMap<NodeId, bool>::type visited;
+  init_hash_map(static_cast<NodeId>(-1), visited);
+  std::priority_queue<NodePoint, std::vector<NodePoint>, LessPoint> candidates;
+  std::priority_queue<NodePoint, std::vector<NodePoint>, GreaterPoint> results;
+  for (size_t i = 0; i < entries.size(); i++) {
+    visited[entries[i].first] = true;
+    candidates.push(entries[i]);
+    results.push(entries[i]);
+    if (results.size() > ef) results.pop();
+  }
+
+  while (!candidates.empty()) {
+    NodePoint candidate = candidates.top();
+    if (results.size() >= ef && candidate.second < results.top().second) break;
+    candidates.pop();
+    const std::vector<NodeId> &links = nodes_[candidate.first].links[level];
+    for (size_t i = 0; i < links.size(); i++) {
+      if (visited.find(links[i]) != visited.end()) continue;
+      visited[links[i]] = true;
+      double point = similarity(vec, nodes_[links[i]]);
+      if (results.size() < ef || point > results.top().second) {
+        candidates.push(NodePoint(links[i], point));
+        results.push(NodePoint(links[i], point));
+        if (results.size() > ef) results.pop();
+      }
+    }
+  }
+
+  entries.clear();
+  while (!results.empty()) {
+    entries.push_back(results.top());
+    results.pop();
+  }
+  std::reverse(entries.begin(), entries.end());
+}
+
+/**
+ * Keep the links of a node within the maximum number.
+ */
+void HnswIndex::shrink_links(NodeId id, size_t level) {
+  std::vector<NodeId> &links = nodes_[id].links[level];
+  size_t max = level == 0 ? max_links_ * 2 : max_links_;
+  if (links.size() <= max) return;
+  std::vector<NodePoint> points;
+  for (size_t i = 0; i < links.size(); i++) {
+    points.push_back(NodePoint(links[i],
+                               similarity(nodes_[id], nodes_[links[i]])));
+  }
+  std::partial_sort(points.begin(), points.begin() + max, points.end(),
+                    greater_pair<NodeId, double>);
+  links.resize(max);
+  for (size_t i = 0; i < max; i++) links[i] = points[i].first;
+}
+
+/**
+ * Set the vector of a node.
+ */
+void HnswIndex::set_vector(NodeId id, const Vector &vec) {
+  std::vector<VecItem> &items = nodes_[id].items;
+  items.clear();
+  for (VecHashMap::const_iterator it = vec.hash_map()->begin();
+       it != vec.hash_map()->end(); ++it) {
+    items.push_back(VecItem(it->first, it->second));
+  }
+  std::sort(items.begin(), items.end());
+}
+
+/**
+ * Add a node.
+ */
+void HnswIndex::add(NodeLabel label, const Vector &vec) {
+  NodeId id = nodes_.size();
+  nodes_.push_back(Node());
+  Node &node = nodes_.back();
+  node.label = label;
+  set_vector(id, vec);
+  size_t level = random_level();
+  node.links.resize(level + 1);
+  if (id == 0) {
+    entry_ = id;
+    return;
+  }
+
+  size_t top = nodes_[entry_].links.size() - 1;
+  std::vector<NodePoint> entries;
+  entries.push_back(NodePoint(entry_, similarity(vec, nodes_[entry_])));
+  for (size_t l = top; l > level; l--) {
+    search_level(vec, entries, 1, l);
+  }
+  for (size_t l = std::min(top, level) + 1; l-- > 0; ) {
+    search_level(vec, entries, ef_construction_, l);
+    for (size_t i = 0; i < entries.size() && i < max_links_; i++) {
+      nodes_[id].links[l].push_back(entries[i].first);
+      nodes_[entries[i].first].links[l].push_back(id);
+      shrink_links(entries[i].first, l);
+    }
+  }
+  if (level > top) entry_ = id;
+}
+
+/**
+ * Search nodes similar to a vector.
+ */
+void HnswIndex::search(const Vector &vec, size_t k,
+                       std::vector<NodePoint> &points) const {
+  points.clear();
+  if (nodes_.empty() || k == 0) return;
+  points.push_back(NodePoint(entry_, similarity(vec, nodes_[entry_])));
+  for (size_t l = nodes_[entry_].links.size() - 1; l > 0; l--) {
+    search_level(vec, points, 1, l);
+  }
+  search_level(vec, points, std::max(ef_, k), 0);
+  if (points.size() > k) points.resize(k);
+}
+
+/**
+ * Save the graph.
+ */
+void HnswIndex::save(std::ostream &os) const {
+  os << max_links_ << DELIMITER << ef_construction_ << DELIMITER
+     << ef_ << DELIMITER << entry_ << DELIMITER << nodes_.size() << std::endl;
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    const Node &node = nodes_[i];
+    os << node.label << DELIMITER << node.links.size();
+    for (size_t l = 0; l < node.links.size(); l++) {
+      os << DELIMITER << node.links[l].size();
+      for (size_t j = 0; j < node.links[l].size(); j++) {
+        os << DELIMITER << node.links[l][j];
+      }
+    }
+    os << std::endl;
+  }
+}
+
+/**
+ * Load a graph saved by save().
+ */
+bool HnswIndex::load(std::istream &is) {
+  clear();
+  std::string line;
+  std::vector<std::string> fields;
+  if (!std::getline(is, line)) return false;
+  split_string(line, DELIMITER, fields);
+  if (fields.size() != 5) return false;
+  set_max_links(strtoul(fields[0].c_str(), NULL, 10));
+  set_ef_construction(strtoul(fields[1].c_str(), NULL, 10));
+  set_ef(strtoul(fields[2].c_str(), NULL, 10));
+  NodeId entry = strtoul(fields[3].c_str(), NULL, 10);
+  size_t size = strtoul(fields[4].c_str(), NULL, 10);
+
+  std::vector<Node> nodes(size);
+  for (size_t i = 0; i < size; i++) {
+    fields.clear();
+    if (!std::getline(is, line)) return false;
+    split_string(line, DELIMITER, fields);
+    size_t pos = 0;
+    if (fields.size() < 2) return false;
+    Node &node = nodes[i];
+    node.label = atol(fields[pos++].c_str());
+    size_t nlevels = strtoul(fields[pos++].c_str(), NULL, 10);
+    if (nlevels == 0 || nlevels > fields.size()) return false;
+    node.links.resize(nlevels);
+    for (size_t l = 0; l < node.links.size(); l++) {
+      if (pos >= fields.size()) return false;
+      size_t nlinks = strtoul(fields[pos++].c_str(), NULL, 10);
+      if (pos + nlinks > fields.size()) return false;
+      for (size_t j = 0; j < nlinks; j++) {
+        NodeId link = strtoul(fields[pos++].c_str(), NULL, 10);
+        if (link >= size) return false;
+        node.links[l].push_back(link);
+      }
+    }
+  }
+  if (size > 0 && entry >= size) return false;
+  // linked nodes must exist on the level of links
+  for (size_t i = 0; i < size; i++) {
+    if (nodes[i].links.size() > nodes[entry].links.size()) return false;
+    for (size_t l = 0; l < nodes[i].links.size(); l++) {
+      for (size_t j = 0; j < nodes[i].links[l].size(); j++) {
+        if (nodes[nodes[i].links[l][j]].links.size() <= l) return false;
+      }
+    }
+  }
+  nodes_.swap(nodes);
+  entry_ = entry;
+  return true;
+}
+
+} /* namespace bayon */
@@ -0,0 +1,224 @@
+//
+// Hierarchical navigable small world graph
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#ifndef BAYON_HNSW_H_
+#define BAYON_HNSW_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <iostream>
+#include <utility>
+#include <vector>
+#include "byvector.h"
+
+namespace bayon {
+
+/**
+ * HnswIndex class.
+ * Approximate nearest neighbor search of normalized vectors
+ * by inner products on a hierarchical navigable small world graph.
+ */
+class HnswIndex {
+ public:
+  /** the label of a node */
+  typedef long NodeLabel;
+  /** the index of a node */
+  typedef size_t NodeId;
+  /** a pair of a node and a similarity point */
+  typedef std::pair<NodeId, double> NodePoint;
+
+  /** default maximum number of links of a node */
+  static const size_t DEFAULT_MAX_LINKS = 16;
+  /** default size of the candidate list in construction */
+  static const size_t DEFAULT_EF_CONSTRUCTION = 100;
+  /** default size of the candidate list in search */
+  static const size_t DEFAULT_EF = 50;
+
+ private:
+  /**
+   * Node of the graph.
+   */
+  struct Node {
+    NodeLabel label;                         ///< the label
+    std::vector<VecItem> items;              ///< items sorted by keys
+    std::vector<std::vector<NodeId> > links; ///< links of each level
+  };
+
+  std::vector<Node> nodes_;  ///< nodes
+  NodeId entry_;             ///< the entry point
+  size_t max_links_;         ///< the maximum number of links of a node
+  size_t ef_construction_;   ///< the size of candidates in construction
+  size_t ef_;                ///< the size of candidates in search
+  unsigned int seed_;        ///< seed of random levels
+
+  /**
+   * Get the inner product of a vector and a node.
+   * @param vec a vector
+   * @param node a node
+   * @return the inner product
+   */
+  static double similarity(const Vector &vec, const Node &node);
+
+  /**
+   * Get the inner product of nodes.
+   * @param node1 a node
+   * @param node2 a node
+   * @return the inner product
+   */
+  static double similarity(const Node &node1, const Node &node2);
+
+  /**
+   * Get a random level of a new node.
+   * @return a level
+   */
+  size_t random_level();
+
+  /**
+   * Search the nearest nodes on a level.
+   * @param vec a query vector
+   * @param entries entry points (and output nearest nodes)
+   * @param ef the size of candidates
+   * @param level a level
+   */
+  void search_level(const Vector &vec, std::vector<NodePoint> &entries,
+                    size_t ef, size_t level) const;
+
+  /**
+   * Keep the links of a node within the maximum number.
+   * @param id a node
+   * @param level a level
+   */
+  void shrink_links(NodeId id, size_t level);
+
+ public:
+  /**
+   * Constructor.
+   */
+  HnswIndex() : entry_(0), max_links_(DEFAULT_MAX_LINKS),
+                ef_construction_(DEFAULT_EF_CONSTRUCTION), ef_(DEFAULT_EF),
+                seed_(DEFAULT_SEED) { }
+
+  /**
+   * Destructor.
+   */
+  ~HnswIndex() { }
+
+  /**
+   * Set the maximum number of links of a node (M).
+   * The nodes on the lowest level have twice as many links.
+   * @param max_links the maximum number of links
+   */
+  void set_max_links(size_t max_links) {
+    max_links_ = max_links > 1 ? max_links : 2;
+  }
+
+  /**
+   * Set the size of candidates in construction (efConstruction).
+   * @param ef the size of candidates
+   */
+  void set_ef_construction(size_t ef) {
+    ef_construction_ = ef > 0 ? ef : 1;
+  }
+
+  /**
+   * Set the size of candidates in search (ef).
+   * A larger value improves the recall and slows down search.
+   * @param ef the size of candidates
+   */
+  void set_ef(size_t ef) {
+    ef_ = ef > 0 ? ef : 1;
+  }
+
+  /**
+   * Get the size of candidates in search.
+   * @return the size of candidates
+   */
+  size_t ef() const {
+    return ef_;
+  }
+
+  /**
+   * Remove all nodes.
+   */
+  void clear() {
+    std::vector<Node>().swap(nodes_);
+    entry_ = 0;
+  }
+
+  /**
+   * Get the number of nodes.
+   * @return the number of nodes
+   */
+  size_t size() const {
+    return nodes_.size();
+  }
+
+  /**
+   * Get the label of a node.
+   * @param id a node
+   * @return the label
+   */
+  NodeLabel label(NodeId id) const {
+    return nodes_[id].label;
+  }
+
+  /**
+   * Set the vector of a node.
+   * @param id a node
+   * @param vec a normalized vector
+   */
+  void set_vector(NodeId id, const Vector &vec);
+
+  /**
+   * Add a node.
+   * @param label the label of a node
+   * @param vec a normalized vector
+   */
+  void add(NodeLabel label, const Vector &vec);
+
+  /**
+   * Search nodes similar to a vector.
+   * @param vec a normalized query vector
+   * @param k the number of output nodes
+   * @param points output nodes and points sorted by points
+   */
+  void search(const Vector &vec, size_t k,
+              std::vector<NodePoint> &points) const;
+
+  /**
+   * Save the labels and links of nodes.
+   * Vectors are not saved.
+   * @param os output stream
+   */
+  void save(std::ostream &os) const;
+
+  /**
+   * Load a graph saved by save().
+   * The vectors of nodes must be set by set_vector() before search.
+   * @param is input stream
+   * @return true if the graph is loaded
+   */
+  bool load(std::istream &is);
+};
+
+} /* namespace bayon */
+
+#endif  // BAYON_HNSW_H_
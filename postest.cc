@@ -0,0 +1,217 @@
+//
+// Tests for PostingList class
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#include <algorithm>
+#include <ctime>
+#include <vector>
+#include <gtest/gtest.h>
+#include "postings.h"
+
+namespace {
+
+const size_t NUM_POSTING = 1000;
+const double MAX_WEIGHT  = 10.0;
+const double PRECISION   = MAX_WEIGHT / 30000;
+
+void init_postings(std::vector<bayon::PostingList::Posting> &postings) {
+  bayon::PostingList::PostingId id = 0;
+  for (size_t i = 0; i < NUM_POSTING; i++) {
+    id += rand() % 1000 + 1;
+    double weight = (static_cast<double>(rand()) / RAND_MAX - 0.5)
+                    * 2 * MAX_WEIGHT;
+    postings.push_back(bayon::PostingList::Posting(id, weight));
+  }
+}
+
+void check_postings(const std::vector<bayon::PostingList::Posting> &expected,
+                    const bayon::PostingList &list) {
+  std::vector<bayon::PostingList::Posting> postings;
+  list.postings(postings);
+  EXPECT_EQ(expected.size(), list.size());
+  EXPECT_EQ(expected.size(), postings.size());
+  for (size_t i = 0; i < expected.size() && i < postings.size(); i++) {
+    EXPECT_EQ(expected[i].first, postings[i].first);
+    EXPECT_NEAR(expected[i].second, postings[i].second, PRECISION);
+  }
+}
+
+} /* namespace */
+
+/* PostingList::add, PostingList::compress */
+TEST(PostingListTest, AddTest) {
+  std::vector<bayon::PostingList::Posting> expected;
+  init_postings(expected);
+  bayon::PostingList list;
+  for (size_t i = 0; i < expected.size(); i++) {
+    list.add(expected[i].first, expected[i].second);
+  }
+  check_postings(expected, list);
+  list.compress();
+  check_postings(expected, list);
+  EXPECT_TRUE(list.memory_size()
+              < expected.size() * sizeof(bayon::PostingList::Posting) / 2);
+
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_TRUE(list.min_weight() <= expected[i].second + PRECISION);
+    EXPECT_TRUE(list.max_weight() >= expected[i].second - PRECISION);
+  }
+}
+
+/* PostingList::set_postings */
+TEST(PostingListTest, SetPostingsTest) {
+  std::vector<bayon::PostingList::Posting> expected;
+  init_postings(expected);
+  bayon::PostingList list;
+  list.set_postings(expected);
+  check_postings(expected, list);
+
+  expected.resize(10);
+  list.set_postings(expected);
+  check_postings(expected, list);
+
+  expected.clear();
+  list.set_postings(expected);
+  check_postings(expected, list);
+  bayon::PostingList::Cursor cursor(&list);
+  EXPECT_TRUE(cursor.end());
+}
+
+/* PostingList::Cursor::skip_to */
+TEST(PostingListTest, SkipToTest) {
+  std::vector<bayon::PostingList::Posting> expected;
+  init_postings(expected);
+  bayon::PostingList list;
+  list.set_postings(expected);
+
+  bayon::PostingList::Cursor cursor(&list);
+  for (size_t i = 0; i < expected.size(); i += rand() % 300 + 1) {
+    cursor.skip_to(expected[i].first);
+    EXPECT_FALSE(cursor.end());
+    EXPECT_EQ(expected[i].first, cursor.id());
+    if (i + 1 < expected.size()) {
+      cursor.skip_to(expected[i].first + 1);
+      EXPECT_EQ(expected[i + 1].first, cursor.id());
+    }
+  }
+  cursor.skip_to(expected.back().first + 1);
+  EXPECT_TRUE(cursor.end());
+}
+
+/* PostingList::truncate */
+TEST(PostingListTest, TruncateTest) {
+  std::vector<bayon::PostingList::Posting> expected;
+  init_postings(expected);
+  bayon::PostingList list;
+  list.set_postings(expected);
+
+  size_t siz = 100;
+  list.truncate(siz);
+  EXPECT_EQ(siz, list.size());
+
+  std::sort(expected.begin(), expected.end(),
+            bayon::greater_pair_abs<bayon::PostingList::PostingId, double>);
+  double min_abs = std::abs(expected[siz - 1].second);
+  std::vector<bayon::PostingList::Posting> postings;
+  list.postings(postings);
+  for (size_t i = 0; i < postings.size(); i++) {
+    EXPECT_TRUE(std::abs(postings[i].second) >= min_abs - PRECISION);
+    if (i > 0) {
+      EXPECT_TRUE(postings[i - 1].first < postings[i].first);
+    }
+  }
+}
+
+/* PostingList::add with the maximum size */
+TEST(PostingListTest, BoundedAddTest) {
+  std::vector<bayon::PostingList::Posting> expected;
+  init_postings(expected);
+  size_t siz = 100;
+  bayon::PostingList list;
+  for (size_t i = 0; i < expected.size(); i++) {
+    list.add(expected[i].first, expected[i].second, siz);
+    EXPECT_TRUE(list.size() <= siz);
+  }
+  EXPECT_EQ(siz, list.size());
+
+  std::sort(expected.begin(), expected.end(),
+            bayon::greater_pair_abs<bayon::PostingList::PostingId, double>);
+  double min_abs = std::abs(expected[siz - 1].second);
+  std::vector<bayon::PostingList::Posting> postings;
+  list.postings(postings);
+  for (size_t i = 0; i < postings.size(); i++) {
+    EXPECT_TRUE(std::abs(postings[i].second) >= min_abs - PRECISION);
+    if (i > 0) {
+      EXPECT_TRUE(postings[i - 1].first < postings[i].first);
+    }
+  }
+}
+
+/* PostingList::add with the maximum size, PostingList::remove */
+TEST(PostingListTest, BoundedRemoveTest) {
+  std::vector<bayon::PostingList::Posting> expected;
+  init_postings(expected);
+  size_t siz = 500;
+  bayon::PostingList list;
+  for (size_t i = 0; i < siz; i++) {
+    list.add(expected[i].first, expected[i].second);
+  }
+  list.compress();
+
+  // tombstones are dropped before live postings
+  std::vector<bool> removed(expected[siz].first + 1, false);
+  for (size_t i = 0; i < siz; i += 2) removed[expected[i].first] = true;
+  EXPECT_TRUE(list.add(expected[siz].first, expected[siz].second, siz,
+                       &removed));
+  EXPECT_EQ(siz / 2 + 1, list.size());
+  EXPECT_TRUE(list.remove(expected[1].first));
+  EXPECT_FALSE(list.remove(expected[1].first));
+  EXPECT_EQ(siz / 2, list.size());
+
+  // uncompressed postings are not quantized again
+  for (size_t i = siz + 1; i < expected.size(); i++) {
+    list.add(expected[i].first, expected[i].second, siz, &removed);
+  }
+  std::vector<bayon::PostingList::Posting> postings;
+  list.postings(postings);
+  EXPECT_EQ(siz, postings.size());
+  for (size_t i = 0; i < postings.size(); i++) {
+    std::vector<bayon::PostingList::Posting>::iterator it =
+      std::lower_bound(expected.begin() + siz, expected.end(), postings[i]);
+    if (it != expected.end() && it->first == postings[i].first) {
+      EXPECT_EQ(it->second, postings[i].second);
+    }
+    if (i > 0) {
+      EXPECT_TRUE(postings[i - 1].first < postings[i].first);
+    }
+  }
+
+  // uncompressed postings are read over blocks
+  bayon::PostingList::Cursor cursor(&list);
+  cursor.skip_to(postings[siz - 10].first);
+  EXPECT_EQ(postings[siz - 10].first, cursor.id());
+
+  list.compress();
+  check_postings(postings, list);
+}
+
+int main(int argc, char **argv) {
+  srand((unsigned int)time(NULL));
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,295 @@
+//
+// Compressed posting list
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#include <algorithm>
+#include <cmath>
+#include "postings.h"
+
+namespace bayon {
+
+const size_t PostingList::BLOCK_SIZE;
+const int PostingList::QUANTIZE_MAX;
+
+/**
+ * Decode the current block.
+ */
+void PostingList::Cursor::load() {
+  pos_ = 0;
+  count_ = 0;
+  if (!list_) return;
+  if (block_ < list_->blocks_.size()) {
+    count_ = list_->decode_block(block_, ids_, weights_);
+  } else {
+    // uncompressed postings are read by the size of a block
+    size_t begin = (block_ - list_->blocks_.size()) * BLOCK_SIZE;
+    for (size_t i = begin;
+         i < list_->tail_.size() && i < begin + BLOCK_SIZE; i++) {
+      ids_[count_] = list_->tail_[i].first;
+      weights_[count_] = list_->tail_[i].second;
+      count_++;
+    }
+  }
+}
+
+/**
+ * Move to the first posting whose identifier is not less than id.
+ */
+void PostingList::Cursor::skip_to(PostingId id) {
+  if (end() || ids_[pos_] >= id) return;
+  if (ids_[count_ - 1] < id) {
+    block_++;
+    while (block_ < list_->blocks_.size() && list_->blocks_[block_].last < id) {
+      block_++;
+    }
+    load();
+    while (!end() && ids_[count_ - 1] < id) {
+      block_++;
+      load();
+    }
+  }
+  pos_ = std::lower_bound(ids_ + pos_, ids_ + count_, id) - ids_;
+}
+
+/**
+ * Compress postings and append them as a block.
+ */
+void PostingList::append_block(const std::vector<Posting> &postings) {
+  if (postings.empty()) return;
+  Block block;
+  block.first = postings.front().first;
+  block.last = postings.back().first;
+  block.offset = bytes_.size();
+  block.start = weights_.size();
+  double max_abs = 0.0;
+  for (size_t i = 0; i < postings.size(); i++) {
+    max_abs = std::max(max_abs, std::abs(postings[i].second));
+  }
+  block.scale = max_abs > 0 ? max_abs / QUANTIZE_MAX : 1.0;
+  blocks_.push_back(block);
+
+  for (size_t i = 0; i < postings.size(); i++) {
+    if (i > 0) {
+      PostingId delta = postings[i].first - postings[i - 1].first;
+      while (delta >= 0x80) {
+        bytes_.push_back(static_cast<unsigned char>((delta & 0x7f) | 0x80));
+        delta >>= 7;
+      }
+      bytes_.push_back(static_cast<unsigned char>(delta));
+    }
+    short quantized =
+      static_cast<short>(floor(postings[i].second / block.scale + 0.5));
+    weights_.push_back(quantized);
+
+    // bounds must also cover decoded weights
+    double decoded = quantized * block.scale;
+    if (decoded > max_weight_) max_weight_ = decoded;
+    if (decoded < min_weight_) min_weight_ = decoded;
+  }
+}
+
+/**
+ * Decode a compressed block.
+ */
+size_t PostingList::decode_block(size_t index, PostingId *ids,
+                                 double *weights) const {
+  const Block &block = blocks_[index];
+  size_t end = (index + 1 < blocks_.size()) ?
+    blocks_[index + 1].start : weights_.size();
+  size_t count = end - block.start;
+  size_t offset = block.offset;
+  for (size_t i = 0; i < count; i++) {
+    if (i == 0) {
+      ids[i] = block.first;
+    } else {
+      PostingId delta = 0;
+      int shift = 0;
+      while (bytes_[offset] & 0x80) {
+        delta |= static_cast<PostingId>(bytes_[offset++] & 0x7f) << shift;
+        shift += 7;
+      }
+      delta |= static_cast<PostingId>(bytes_[offset++]) << shift;
+      ids[i] = ids[i - 1] + delta;
+    }
+    weights[i] = weights_[block.start + i] * block.scale;
+  }
+  return count;
+}
+
+/**
+ * Decode all postings for a bounded list.
+ */
+void PostingList::expand(const std::vector<bool> *removed) {
+  std::vector<Posting> items;
+  postings(items);
+  blocks_.clear();
+  bytes_.clear();
+  weights_.clear();
+  tail_.clear();
+  for (size_t i = 0; i < items.size(); i++) {
+    if (removed && items[i].first < removed->size()
+        && (*removed)[items[i].first]) continue;
+    tail_.push_back(items[i]);
+  }
+  heap_ = tail_;
+  std::make_heap(heap_.begin(), heap_.end(),
+                 greater_pair_abs<PostingId, double>);
+  bounded_ = true;
+}
+
+/**
+ * Find an uncompressed posting.
+ */
+size_t PostingList::find(PostingId id) const {
+  size_t low = 0, high = tail_.size();
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    if (tail_[mid].first < id) low = mid + 1;
+    else                       high = mid;
+  }
+  return low;
+}
+
+/**
+ * Add a posting.
+ */
+void PostingList::add(PostingId id, double weight) {
+  if (size() == 0) {
+    max_weight_ = weight;
+    min_weight_ = weight;
+  } else {
+    if (weight > max_weight_) max_weight_ = weight;
+    if (weight < min_weight_) min_weight_ = weight;
+  }
+  tail_.push_back(Posting(id, weight));
+  if (bounded_) {
+    heap_.push_back(tail_.back());
+    std::push_heap(heap_.begin(), heap_.end(),
+                   greater_pair_abs<PostingId, double>);
+  } else if (tail_.size() >= BLOCK_SIZE) {
+    append_block(tail_);
+    tail_.clear();
+  }
+}
+
+/**
+ * Add a posting keeping at most siz postings
+ * with the largest absolute weights.
+ */
+bool PostingList::add(PostingId id, double weight, size_t siz,
+                      const std::vector<bool> *removed) {
+  if (!bounded_) expand(removed);
+  if (siz == 0) return false;
+  Posting posting(id, weight);
+  while (tail_.size() >= siz) {
+    // the heap keeps removed postings until they come to the top
+    size_t pos = find(heap_.front().first);
+    if (pos == tail_.size() || tail_[pos].first != heap_.front().first) {
+      std::pop_heap(heap_.begin(), heap_.end(),
+                    greater_pair_abs<PostingId, double>);
+      heap_.pop_back();
+      continue;
+    }
+    if (!greater_pair_abs(posting, heap_.front())) return false;
+    tail_.erase(tail_.begin() + pos);
+    std::pop_heap(heap_.begin(), heap_.end(),
+                  greater_pair_abs<PostingId, double>);
+    heap_.pop_back();
+  }
+  add(id, weight);
+  if (heap_.size() > 2 * tail_.size() + BLOCK_SIZE) {
+    heap_ = tail_;
+    std::make_heap(heap_.begin(), heap_.end(),
+                   greater_pair_abs<PostingId, double>);
+  }
+  return true;
+}
+
+/**
+ * Remove a posting of a bounded list.
+ */
+bool PostingList::remove(PostingId id) {
+  if (!bounded_) return false;
+  size_t pos = find(id);
+  if (pos == tail_.size() || tail_[pos].first != id) return false;
+  tail_.erase(tail_.begin() + pos);
+  return true;
+}
+
+/**
+ * Compress uncompressed postings.
+ */
+void PostingList::compress() {
+  if (bounded_) {
+    std::vector<Posting> items;
+    items.swap(tail_);
+    set_postings(items);
+  } else {
+    append_block(tail_);
+  }
+  std::vector<Posting>().swap(tail_);
+  std::vector<Block>(blocks_).swap(blocks_);
+  std::vector<unsigned char>(bytes_).swap(bytes_);
+  std::vector<short>(weights_).swap(weights_);
+}
+
+/**
+ * Get all postings.
+ */
+void PostingList::postings(std::vector<Posting> &postings) const {
+  for (Cursor cursor(this); !cursor.end(); cursor.next()) {
+    postings.push_back(Posting(cursor.id(), cursor.weight()));
+  }
+}
+
+/**
+ * Replace all postings.
+ */
+void PostingList::set_postings(const std::vector<Posting> &postings) {
+  blocks_.clear();
+  bytes_.clear();
+  weights_.clear();
+  tail_.clear();
+  std::vector<Posting>().swap(heap_);
+  bounded_ = false;
+  max_weight_ = min_weight_ = postings.empty() ? 0.0 : postings[0].second;
+  for (size_t i = 0; i < postings.size(); i++) {
+    if (postings[i].second > max_weight_) max_weight_ = postings[i].second;
+    if (postings[i].second < min_weight_) min_weight_ = postings[i].second;
+  }
+  for (size_t i = 0; i < postings.size(); i += BLOCK_SIZE) {
+    size_t end = std::min(i + BLOCK_SIZE, postings.size());
+    std::vector<Posting> block(postings.begin() + i, postings.begin() + end);
+    append_block(block);
+  }
+}
+
+/**
+ * Keep the postings with the largest absolute weights.
+ */
+void PostingList::truncate(size_t siz) {
+  if (size() <= siz) return;
+  std::vector<Posting> items;
+  postings(items);
+  std::sort(items.begin(), items.end(), greater_pair_abs<PostingId, double>);
+  items.resize(siz);
+  std::sort(items.begin(), items.end());
+  set_postings(items);
+}
+
+} /* namespace bayon */
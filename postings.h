@@ -0,0 +1,284 @@
+//
+// Compressed posting list
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#ifndef BAYON_POSTINGS_H_
+#define BAYON_POSTINGS_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <utility>
+#include <vector>
+#include "util.h"
+
+namespace bayon {
+
+/**
+ * PostingList class.
+ * Postings are sorted by identifiers and stored in blocks.
+ * The identifiers in a block are delta-encoded with variable byte codes
+ * and the weights are quantized into 16 bits with a scale of each block.
+ * Recently added postings are kept uncompressed until a block is filled.
+ * A list bounded by its size keeps all postings uncompressed with a heap
+ * of their absolute weights until it is compressed.
+ */
+class PostingList {
+ public:
+  /** the identifier of a posting */
+  typedef size_t PostingId;
+  /** a pair of an identifier and a weight */
+  typedef std::pair<PostingId, double> Posting;
+
+  /** the number of postings in a block */
+  static const size_t BLOCK_SIZE = 128;
+
+ private:
+  /** the maximum absolute value of quantized weights */
+  static const int QUANTIZE_MAX = 32767;
+
+  /**
+   * Header of a compressed block.
+   */
+  struct Block {
+    PostingId first;  ///< the first identifier
+    PostingId last;   ///< the last identifier
+    size_t offset;    ///< offset of the identifiers in bytes_
+    size_t start;     ///< offset of the weights in weights_
+    double scale;     ///< scale of quantized weights
+  };
+
+  std::vector<Block> blocks_;          ///< headers of compressed blocks
+  std::vector<unsigned char> bytes_;   ///< delta-encoded identifiers
+  std::vector<short> weights_;         ///< quantized weights
+  std::vector<Posting> tail_;          ///< uncompressed postings
+  std::vector<Posting> heap_;          ///< postings of a bounded list
+  bool bounded_;                       ///< all postings are uncompressed
+  double max_weight_;                  ///< the maximum weight
+  double min_weight_;                  ///< the minimum weight
+
+  /**
+   * Compress postings and append them as a block.
+   * @param postings postings sorted by identifiers
+   */
+  void append_block(const std::vector<Posting> &postings);
+
+  /**
+   * Decode a compressed block.
+   * @param index the index of a block
+   * @param ids output identifiers
+   * @param weights output weights
+   * @return the number of decoded postings
+   */
+  size_t decode_block(size_t index, PostingId *ids, double *weights) const;
+
+  /**
+   * Decode all postings into uncompressed postings and a heap
+   * for a bounded list.
+   * @param removed tombstones of identifiers not to be decoded
+   */
+  void expand(const std::vector<bool> *removed);
+
+  /**
+   * Find an uncompressed posting.
+   * @param id an identifier
+   * @return the position of the posting in tail_
+   */
+  size_t find(PostingId id) const;
+
+ public:
+  /**
+   * Cursor for the traversal of a posting list.
+   * Postings are decoded block by block.
+   */
+  class Cursor {
+   private:
+    const PostingList *list_;     ///< a posting list
+    size_t block_;                ///< the index of the current block
+    size_t pos_;                  ///< position in the current block
+    size_t count_;                ///< the number of decoded postings
+    PostingId ids_[BLOCK_SIZE];   ///< decoded identifiers
+    double weights_[BLOCK_SIZE];  ///< decoded weights
+
+    /**
+     * Decode the current block.
+     */
+    void load();
+
+   public:
+    /**
+     * Constructor.
+     */
+    Cursor() : list_(NULL), block_(0), pos_(0), count_(0) { }
+
+    /**
+     * Constructor.
+     * @param list a posting list
+     */
+    explicit Cursor(const PostingList *list)
+      : list_(list), block_(0), pos_(0), count_(0) {
+      load();
+    }
+
+    /**
+     * Check whether the cursor reaches the end.
+     * @return true if no posting remains
+     */
+    bool end() const {
+      return pos_ >= count_;
+    }
+
+    /**
+     * Get the identifier of the current posting.
+     * @return an identifier
+     */
+    PostingId id() const {
+      return ids_[pos_];
+    }
+
+    /**
+     * Get the weight of the current posting.
+     * @return a weight
+     */
+    double weight() const {
+      return weights_[pos_];
+    }
+
+    /**
+     * Move to the next posting.
+     */
+    void next() {
+      if (++pos_ >= count_ && count_ > 0) {
+        block_++;
+        load();
+      }
+    }
+
+    /**
+     * Move to the first posting whose identifier is not less than id.
+     * @param id an identifier
+     */
+    void skip_to(PostingId id);
+  };
+
+  /**
+   * Constructor.
+   */
+  PostingList() : bounded_(false), max_weight_(0.0), min_weight_(0.0) { }
+
+  /**
+   * Destructor.
+   */
+  ~PostingList() { }
+
+  /**
+   * Add a posting.
+   * The identifier must be greater than those of existing postings.
+   * @param id an identifier
+   * @param weight a weight
+   */
+  void add(PostingId id, double weight);
+
+  /**
+   * Add a posting keeping at most siz postings
+   * with the largest absolute weights.
+   * The identifier must be greater than those of existing postings.
+   * Compressed postings are decoded once, except tombstones, and all
+   * postings are kept uncompressed until compress() is called.
+   * The bounds of weights may remain those of dropped postings.
+   * @param id an identifier
+   * @param weight a weight
+   * @param siz the maximum number of postings
+   * @param removed tombstones of identifiers (NULL: no tombstones)
+   * @return true if the posting is added
+   */
+  bool add(PostingId id, double weight, size_t siz,
+           const std::vector<bool> *removed = NULL);
+
+  /**
+   * Remove a posting of a bounded list.
+   * Compressed postings are not removed.
+   * @param id an identifier
+   * @return true if the posting is removed
+   */
+  bool remove(PostingId id);
+
+  /**
+   * Compress uncompressed postings.
+   */
+  void compress();
+
+  /**
+   * Get all postings.
+   * @param postings output postings sorted by identifiers
+   */
+  void postings(std::vector<Posting> &postings) const;
+
+  /**
+   * Replace all postings.
+   * @param postings postings sorted by identifiers
+   */
+  void set_postings(const std::vector<Posting> &postings);
+
+  /**
+   * Keep the postings with the largest absolute weights.
+   * @param siz the maximum number of postings
+   */
+  void truncate(size_t siz);
+
+  /**
+   * Get the number of postings.
+   * @return the number of postings
+   */
+  size_t size() const {
+    return weights_.size() + tail_.size();
+  }
+
+  /**
+   * Get the maximum weight.
+   * @return the maximum weight
+   */
+  double max_weight() const {
+    return max_weight_;
+  }
+
+  /**
+   * Get the minimum weight.
+   * @return the minimum weight
+   */
+  double min_weight() const {
+    return min_weight_;
+  }
+
+  /**
+   * Get the size of allocated memory for postings.
+   * @return the size in bytes
+   */
+  size_t memory_size() const {
+    return blocks_.capacity() * sizeof(Block)
+           + bytes_.capacity() * sizeof(unsigned char)
+           + weights_.capacity() * sizeof(short)
+           + tail_.capacity() * sizeof(Posting)
+           + heap_.capacity() * sizeof(Posting);
+  }
+};
+
+} /* namespace bayon */
+
+#endif  // BAYON_POSTINGS_H_
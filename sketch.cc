@@ -0,0 +1,121 @@
+//
+// Count-min sketch of document frequency
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#include <algorithm>
+#include <limits>
+#include "sketch.h"
+
+namespace bayon {
+
+const size_t CountMinSketch::DEFAULT_DEPTH;
+
+/**
+ * Constructor.
+ */
+CountMinSketch::CountMinSketch(size_t width, size_t depth)
+  : width_(width > 0 ? width : 1), depth_(depth > 0 ? depth : 1),
+    counters_(width_ * depth_, 0), total_(0), heavy_size_(0),
+    heavy_min_(0) {
+  init_hash_map(VECTOR_EMPTY_KEY, heavy_);
+#ifdef HAVE_GOOGLE_DENSE_HASH_MAP
+  heavy_.set_deleted_key(VECTOR_DELETED_KEY);
+#endif
+}
+
+/**
+ * Get the column of a key in a row.
+ */
+size_t CountMinSketch::column(VecKey key, size_t row) const {
+  // the finalizer of MurmurHash3 with a seed of each row
+  unsigned long long h = static_cast<unsigned long long>(key)
+                         + (row + 1) * 0x9e3779b97f4a7c15ULL;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return static_cast<size_t>(h % width_);
+}
+
+/**
+ * Add a count of a key.
+ */
+void CountMinSketch::add(VecKey key, size_t count) {
+  total_ += count;
+
+  // conservative update: raise only the counters below the new estimate
+  size_t min = std::numeric_limits<size_t>::max();
+  for (size_t i = 0; i < depth_; i++) {
+    min = std::min(min, static_cast<size_t>(
+                          counters_[i * width_ + column(key, i)]));
+  }
+  size_t estimate = std::min(min + count, static_cast<size_t>(
+                               std::numeric_limits<Counter>::max()));
+  for (size_t i = 0; i < depth_; i++) {
+    Counter &counter = counters_[i * width_ + column(key, i)];
+    if (counter < estimate) counter = static_cast<Counter>(estimate);
+  }
+  if (heavy_size_ > 0) update_heavy(key, count, estimate);
+}
+
+/**
+ * Update the table of heavy hitters.
+ */
+void CountMinSketch::update_heavy(VecKey key, size_t count,
+                                  size_t estimate) {
+  HashMap<VecKey, size_t>::type::iterator it = heavy_.find(key);
+  if (it != heavy_.end()) {
+    it->second += count;
+    return;
+  }
+  if (heavy_.size() < heavy_size_) {
+    heavy_[key] = estimate;
+    if (heavy_.size() == 1 || estimate < heavy_min_) heavy_min_ = estimate;
+    return;
+  }
+  if (estimate <= heavy_min_) return;
+
+  // heavy_min_ may be stale since counts in the table only grow
+  HashMap<VecKey, size_t>::type::iterator min_it = heavy_.begin();
+  for (it = heavy_.begin(); it != heavy_.end(); ++it) {
+    if (it->second < min_it->second) min_it = it;
+  }
+  heavy_min_ = min_it->second;
+  if (estimate <= heavy_min_) return;
+  heavy_.erase(min_it);
+  heavy_[key] = estimate;
+}
+
+/**
+ * Get the estimated count of a key.
+ */
+size_t CountMinSketch::estimate(VecKey key) const {
+  if (heavy_size_ > 0) {
+    HashMap<VecKey, size_t>::type::const_iterator it = heavy_.find(key);
+    if (it != heavy_.end()) return it->second;
+  }
+  size_t min = std::numeric_limits<size_t>::max();
+  for (size_t i = 0; i < depth_; i++) {
+    min = std::min(min, static_cast<size_t>(
+                          counters_[i * width_ + column(key, i)]));
+  }
+  return min;
+}
+
+} /* namespace bayon */
@@ -0,0 +1,164 @@
+//
+// Count-min sketch of document frequency
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#ifndef BAYON_SKETCH_H_
+#define BAYON_SKETCH_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <vector>
+#include "byvector.h"
+
+namespace bayon {
+
+/**
+ * CountMinSketch class.
+ * Counts of keys in a fixed memory with conservative update.
+ * An estimate is never less than the true count and exceeds it by
+ * at most e / width * (total count) with probability 1 - exp(-depth).
+ * The most frequent keys can be counted in an exact table
+ * of heavy hitters besides the sketch.
+ */
+class CountMinSketch {
+ public:
+  /** a counter */
+  typedef unsigned int Counter;
+
+  /** default number of rows */
+  static const size_t DEFAULT_DEPTH = 4;
+
+ private:
+  size_t width_;                              ///< counters of a row
+  size_t depth_;                              ///< the number of rows
+  std::vector<Counter> counters_;             ///< rows of counters
+  size_t total_;                              ///< total count
+  size_t heavy_size_;                         ///< max size of heavy hitters
+  HashMap<VecKey, size_t>::type heavy_;       ///< counts of heavy hitters
+  size_t heavy_min_;                          ///< lower bound of the counts
+
+  /**
+   * Get the column of a key in a row.
+   * @param key a key
+   * @param row a row
+   * @return the column
+   */
+  size_t column(VecKey key, size_t row) const;
+
+  /**
+   * Update the table of heavy hitters.
+   * @param key a key
+   * @param count the count of this update
+   * @param estimate the estimated count of a key
+   */
+  void update_heavy(VecKey key, size_t count, size_t estimate);
+
+ public:
+  /**
+   * Constructor.
+   * @param width the number of counters of a row
+   * @param depth the number of rows
+   */
+  CountMinSketch(size_t width, size_t depth);
+
+  /**
+   * Destructor.
+   */
+  ~CountMinSketch() { }
+
+  /**
+   * Get the width for the memory size.
+   * @param memory the memory size of counters in bytes
+   * @param depth the number of rows
+   * @return the number of counters of a row
+   */
+  static size_t width_for_memory(size_t memory, size_t depth) {
+    size_t width = memory / (depth > 0 ? depth : 1) / sizeof(Counter);
+    return width > 0 ? width : 1;
+  }
+
+  /**
+   * Set the maximum size of the table of heavy hitters.
+   * Keys whose estimates exceed the smallest count in the table
+   * replace it, and they are counted exactly afterward.
+   * @param siz the maximum size (0: no table)
+   */
+  void set_heavy_size(size_t siz) {
+    heavy_size_ = siz;
+  }
+
+  /**
+   * Add a count of a key.
+   * @param key a key
+   * @param count a count
+   */
+  void add(VecKey key, size_t count = 1);
+
+  /**
+   * Get the estimated count of a key.
+   * @param key a key
+   * @return the estimated count
+   */
+  size_t estimate(VecKey key) const;
+
+  /**
+   * Get the heavy hitters.
+   * @return pairs of keys and counts
+   */
+  const HashMap<VecKey, size_t>::type &heavy_hitters() const {
+    return heavy_;
+  }
+
+  /**
+   * Get the total count.
+   * @return the total count
+   */
+  size_t total() const {
+    return total_;
+  }
+
+  /**
+   * Get the width of the sketch.
+   * @return the number of counters of a row
+   */
+  size_t width() const {
+    return width_;
+  }
+
+  /**
+   * Get the depth of the sketch.
+   * @return the number of rows
+   */
+  size_t depth() const {
+    return depth_;
+  }
+
+  /**
+   * Get the memory size of counters.
+   * @return the size in bytes
+   */
+  size_t memory_size() const {
+    return counters_.size() * sizeof(Counter);
+  }
+};
+
+} /* namespace bayon */
+
+#endif  // BAYON_SKETCH_H_
@@ -0,0 +1,113 @@
+//
+// Tests for CountMinSketch class
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include "sketch.h"
+
+namespace {
+
+const size_t NUM_KEY = 10000;
+const size_t SKETCH_WIDTH = 2000;
+
+/* Zipf-like counts: the i-th key appears NUM_KEY / (i + 1) times */
+void add_counts(bayon::CountMinSketch &sketch, std::vector<size_t> &counts) {
+  counts.resize(NUM_KEY);
+  for (size_t i = 0; i < NUM_KEY; i++) {
+    counts[i] = NUM_KEY / (i + 1);
+  }
+  for (size_t n = 0; n < counts[0]; n++) {
+    for (size_t i = 0; i < NUM_KEY && n < counts[i]; i++) {
+      sketch.add(i);
+    }
+  }
+}
+
+} /* namespace */
+
+/* CountMinSketch::add, CountMinSketch::estimate */
+TEST(CountMinSketchTest, EstimateTest) {
+  bayon::CountMinSketch sketch(SKETCH_WIDTH,
+                               bayon::CountMinSketch::DEFAULT_DEPTH);
+  std::vector<size_t> counts;
+  add_counts(sketch, counts);
+
+  size_t total = 0;
+  for (size_t i = 0; i < counts.size(); i++) total += counts[i];
+  EXPECT_EQ(sketch.total(), total);
+
+  // never underestimated, and within the error bound for most keys
+  double bound = M_E / SKETCH_WIDTH * total;
+  size_t nerrors = 0;
+  for (size_t i = 0; i < counts.size(); i++) {
+    size_t estimate = sketch.estimate(i);
+    EXPECT_GE(estimate, counts[i]);
+    if (estimate - counts[i] > bound) nerrors++;
+  }
+  EXPECT_LT(nerrors, counts.size() * 5 / 100);
+  EXPECT_EQ(sketch.memory_size(), SKETCH_WIDTH
+            * bayon::CountMinSketch::DEFAULT_DEPTH
+            * sizeof(bayon::CountMinSketch::Counter));
+}
+
+/* CountMinSketch::add with counts */
+TEST(CountMinSketchTest, AddCountTest) {
+  bayon::CountMinSketch sketch(100, 2);
+  sketch.add(1, 10);
+  sketch.add(2, 5);
+  sketch.add(1);
+  EXPECT_GE(sketch.estimate(1), 11U);
+  EXPECT_GE(sketch.estimate(2), 5U);
+  EXPECT_EQ(sketch.total(), 16U);
+  EXPECT_EQ(bayon::CountMinSketch::width_for_memory(1024, 2),
+            1024 / 2 / sizeof(bayon::CountMinSketch::Counter));
+}
+
+/* CountMinSketch::set_heavy_size */
+TEST(CountMinSketchTest, HeavyHitterTest) {
+  bayon::CountMinSketch sketch(SKETCH_WIDTH / 10,
+                               bayon::CountMinSketch::DEFAULT_DEPTH);
+  sketch.set_heavy_size(10);
+  std::vector<size_t> counts;
+  add_counts(sketch, counts);
+
+  const bayon::HashMap<bayon::VecKey, size_t>::type &heavy =
+    sketch.heavy_hitters();
+  EXPECT_EQ(heavy.size(), 10U);
+  for (size_t i = 0; i < 5; i++) {
+    EXPECT_TRUE(heavy.find(i) != heavy.end());
+  }
+  for (size_t i = 0; i < counts.size(); i++) {
+    EXPECT_GE(sketch.estimate(i), counts[i]);
+  }
+
+  // heavy hitters are counted exactly after they enter the table
+  bayon::CountMinSketch plain(SKETCH_WIDTH / 10,
+                              bayon::CountMinSketch::DEFAULT_DEPTH);
+  add_counts(plain, counts);
+  for (size_t i = 0; i < 5; i++) {
+    EXPECT_LE(sketch.estimate(i), plain.estimate(i));
+  }
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,137 @@
+//
+// Immutable vocabulary with a minimal perfect hash and hashed keys
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#include <algorithm>
+#include "vocab.h"
+
+namespace {
+
+/**
+ * Order of buckets by their sizes (larger first).
+ */
+struct GreaterBucket {
+  const std::vector<std::vector<size_t> > *buckets;
+  bool operator()(size_t left, size_t right) const {
+    return (*buckets)[left].size() > (*buckets)[right].size();
+  }
+};
+
+} /* namespace */
+
+namespace bayon {
+
+const size_t Vocabulary::BUCKET_SIZE;
+const unsigned int Vocabulary::MAX_DISPLACEMENT;
+const size_t FeatureHasher::MAX_BITS;
+
+/**
+ * Get the hash value of a term.
+ */
+size_t Vocabulary::hash(const char *term, size_t len, size_t seed) {
+  // FNV-1a and the finalizer of MurmurHash3
+  unsigned long long h = 14695981039346656037ULL
+                         ^ (seed * 0x9e3779b97f4a7c15ULL);
+  for (size_t i = 0; i < len; i++) {
+    h ^= static_cast<unsigned char>(term[i]);
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return static_cast<size_t>(h);
+}
+
+/**
+ * Build the vocabulary.
+ */
+bool Vocabulary::build(const std::vector<Term> &terms) {
+  pool_.clear();
+  offsets_.clear();
+  keys_.clear();
+  displacements_.clear();
+  nterms_ = 0;
+  if (terms.empty()) return true;
+
+  // slack slots keep the search of displacements of the last buckets short
+  size_t nslots = terms.size() + terms.size() / 5 + 1;
+  size_t nbuckets = (nslots + BUCKET_SIZE - 1) / BUCKET_SIZE;
+  std::vector<std::vector<size_t> > buckets(nbuckets);
+  for (size_t i = 0; i < terms.size(); i++) {
+    const std::string &term = terms[i].first;
+    buckets[hash(term.data(), term.size(), 0) % nbuckets].push_back(i);
+  }
+  std::vector<size_t> order(nbuckets);
+  for (size_t i = 0; i < nbuckets; i++) order[i] = i;
+  GreaterBucket greater;
+  greater.buckets = &buckets;
+  std::stable_sort(order.begin(), order.end(), greater);
+
+  // place larger buckets first
+  std::vector<unsigned int> displacements(nbuckets, 0);
+  std::vector<size_t> placed(nslots, terms.size());
+  std::vector<size_t> slots;
+  for (size_t i = 0; i < nbuckets; i++) {
+    const std::vector<size_t> &bucket = buckets[order[i]];
+    if (bucket.empty()) break;
+    for (size_t j = 0; j < bucket.size(); j++) {
+      for (size_t k = j + 1; k < bucket.size(); k++) {
+        if (terms[bucket[j]].first == terms[bucket[k]].first) return false;
+      }
+    }
+    unsigned int d = 0;
+    for (; d < MAX_DISPLACEMENT; d++) {
+      slots.clear();
+      bool ok = true;
+      for (size_t j = 0; j < bucket.size() && ok; j++) {
+        const std::string &term = terms[bucket[j]].first;
+        size_t slot = hash(term.data(), term.size(), d + 1) % nslots;
+        ok = placed[slot] == terms.size()
+             && std::find(slots.begin(), slots.end(), slot) == slots.end();
+        slots.push_back(slot);
+      }
+      if (ok) break;
+    }
+    if (d == MAX_DISPLACEMENT) return false;
+    displacements[order[i]] = d;
+    for (size_t j = 0; j < bucket.size(); j++) placed[slots[j]] = bucket[j];
+  }
+
+  size_t total = 0;
+  for (size_t i = 0; i < terms.size(); i++) total += terms[i].first.size();
+  pool_.reserve(total);
+  offsets_.reserve(nslots + 1);
+  keys_.reserve(nslots);
+  for (size_t i = 0; i < nslots; i++) {
+    offsets_.push_back(pool_.size());
+    if (placed[i] == terms.size()) {
+      keys_.push_back(VECTOR_EMPTY_KEY);
+    } else {
+      pool_ += terms[placed[i]].first;
+      keys_.push_back(terms[placed[i]].second);
+    }
+  }
+  offsets_.push_back(pool_.size());
+  displacements_.swap(displacements);
+  nterms_ = terms.size();
+  return true;
+}
+
+} /* namespace bayon */
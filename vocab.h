@@ -0,0 +1,205 @@
+//
+// Immutable vocabulary with a minimal perfect hash and hashed keys
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#ifndef BAYON_VOCAB_H_
+#define BAYON_VOCAB_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "byvector.h"
+
+namespace bayon {
+
+/**
+ * Vocabulary class.
+ * Immutable map from terms to vector keys.
+ * Terms are placed by a perfect hash (hash and displace) into about
+ * 20% more slots than terms and kept in a single string pool, so a lookup
+ * computes two hash values and compares one term without any allocation.
+ */
+class Vocabulary {
+ public:
+  /** a pair of a term and its key */
+  typedef std::pair<std::string, VecKey> Term;
+
+  /** average number of terms in a bucket of displacements */
+  static const size_t BUCKET_SIZE = 4;
+  /** maximum number of tried displacements of a bucket */
+  static const unsigned int MAX_DISPLACEMENT = 1U << 24;
+
+ private:
+  std::string pool_;                        ///< terms in the order of slots
+  std::vector<size_t> offsets_;             ///< offsets of terms in the pool
+  std::vector<VecKey> keys_;                ///< keys of slots
+  std::vector<unsigned int> displacements_; ///< displacements of buckets
+  size_t nterms_;                           ///< the number of terms
+
+ public:
+  /**
+   * Get the hash value of a term.
+   * @param term a term
+   * @param len the length of a term
+   * @param seed a seed
+   * @return the hash value
+   */
+  static size_t hash(const char *term, size_t len, size_t seed);
+
+  /**
+   * Constructor.
+   */
+  Vocabulary() : nterms_(0) { }
+
+  /**
+   * Destructor.
+   */
+  ~Vocabulary() { }
+
+  /**
+   * Build the vocabulary.
+   * The build fails when terms are duplicated, or when no displacement
+   * of a bucket is found in MAX_DISPLACEMENT trials, which is unlikely
+   * with the slack slots. A failed vocabulary has no terms.
+   * @param terms pairs of unique terms and their keys
+   * @return true if the vocabulary is built
+   */
+  bool build(const std::vector<Term> &terms);
+
+  /**
+   * Find the key of a term.
+   * @param term a term (need not be terminated by null)
+   * @param len the length of a term
+   * @param key output key
+   * @return true if the term is found
+   */
+  bool find(const char *term, size_t len, VecKey &key) const {
+    if (keys_.empty()) return false;
+    size_t bucket = hash(term, len, 0) % displacements_.size();
+    size_t slot = hash(term, len, displacements_[bucket] + 1) % keys_.size();
+    size_t offset = offsets_[slot];
+    if (keys_[slot] == VECTOR_EMPTY_KEY
+        || offsets_[slot + 1] - offset != len
+        || memcmp(pool_.data() + offset, term, len) != 0) {
+      return false;
+    }
+    key = keys_[slot];
+    return true;
+  }
+
+  /**
+   * Find the key of a term.
+   * @param term a term
+   * @param key output key
+   * @return true if the term is found
+   */
+  bool find(const std::string &term, VecKey &key) const {
+    return find(term.data(), term.size(), key);
+  }
+
+  /**
+   * Get the number of terms.
+   * @return the number of terms
+   */
+  size_t size() const {
+    return nterms_;
+  }
+
+  /**
+   * Get the memory size of the vocabulary.
+   * @return the size in bytes
+   */
+  size_t memory_size() const {
+    return pool_.capacity() + offsets_.capacity() * sizeof(size_t)
+           + keys_.capacity() * sizeof(VecKey)
+           + displacements_.capacity() * sizeof(unsigned int);
+  }
+};
+
+
+/**
+ * FeatureHasher class.
+ * Map from terms to vector keys by their hash values without
+ * any dictionary. Different terms may share a key; with signed
+ * hashing, colliding terms are added with random signs so that
+ * their values cancel out in inner products on average.
+ */
+class FeatureHasher {
+ public:
+  /** maximum number of bits of hashed keys */
+  static const size_t MAX_BITS = 32;
+
+ private:
+  VecKey mask_;  ///< mask of hashed keys
+  bool signed_;  ///< true if values have signs of hash values
+
+ public:
+  /**
+   * Constructor.
+   * @param bits the number of bits of hashed keys (1 - MAX_BITS)
+   * @param sign true if values have signs of hash values
+   */
+  FeatureHasher(size_t bits, bool sign)
+    : mask_((static_cast<VecKey>(1) << bits) - 1), signed_(sign) { }
+
+  /**
+   * Destructor.
+   */
+  ~FeatureHasher() { }
+
+  /**
+   * Get the key of a term.
+   * @param term a term (need not be terminated by null)
+   * @param len the length of a term
+   * @param sign output sign of the value of a term (1 or -1)
+   * @return the key
+   */
+  VecKey find(const char *term, size_t len, VecValue &sign) const {
+    size_t h = Vocabulary::hash(term, len, 0);
+    // the highest bit is not used by keys
+    sign = (signed_ && (h >> (sizeof(size_t) * 8 - 1))) ? -1.0 : 1.0;
+    return static_cast<VecKey>(h) & mask_;
+  }
+
+  /**
+   * Get the key of a term.
+   * @param term a term
+   * @param sign output sign of the value of a term (1 or -1)
+   * @return the key
+   */
+  VecKey find(const std::string &term, VecValue &sign) const {
+    return find(term.data(), term.size(), sign);
+  }
+
+  /**
+   * Get the number of keys.
+   * @return the number of keys
+   */
+  size_t size() const {
+    return static_cast<size_t>(mask_) + 1;
+  }
+};
+
+} /* namespace bayon */
+
+#endif  // BAYON_VOCAB_H_
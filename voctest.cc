@@ -0,0 +1,113 @@
+//
+// Tests for Vocabulary class
+//
+// Copyright(C) 2010  Mizuki Fujisawa <fujisawa@bayon.cc>
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; version 2 of the License.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "vocab.h"
+
+namespace {
+
+const size_t NUM_TERM = 10000;
+
+void init_terms(std::vector<bayon::Vocabulary::Term> &terms) {
+  char buf[32];
+  for (size_t i = 0; i < NUM_TERM; i++) {
+    snprintf(buf, sizeof(buf), "term%zd", i);
+    terms.push_back(bayon::Vocabulary::Term(buf, i * 3));
+  }
+}
+
+} /* namespace */
+
+/* Vocabulary::build, Vocabulary::find */
+TEST(VocabularyTest, FindTest) {
+  std::vector<bayon::Vocabulary::Term> terms;
+  init_terms(terms);
+  bayon::Vocabulary vocab;
+  EXPECT_TRUE(vocab.build(terms));
+  EXPECT_EQ(vocab.size(), NUM_TERM);
+
+  bayon::VecKey key;
+  for (size_t i = 0; i < terms.size(); i++) {
+    ASSERT_TRUE(vocab.find(terms[i].first, key));
+    EXPECT_EQ(key, terms[i].second);
+  }
+  EXPECT_FALSE(vocab.find("term", key));
+  EXPECT_FALSE(vocab.find("term10000", key));
+  EXPECT_FALSE(vocab.find("", key));
+
+  // a term in a line need not be terminated by null
+  std::string line("term12\tterm345\t1");
+  EXPECT_TRUE(vocab.find(line.data() + 7, 7, key));
+  EXPECT_EQ(key, 345 * 3);
+  EXPECT_TRUE(vocab.find(line.data(), 6, key));
+  EXPECT_EQ(key, 12 * 3);
+}
+
+/* Vocabulary::build with empty or duplicated terms */
+TEST(VocabularyTest, BuildTest) {
+  std::vector<bayon::Vocabulary::Term> terms;
+  bayon::Vocabulary vocab;
+  EXPECT_TRUE(vocab.build(terms));
+  bayon::VecKey key;
+  EXPECT_FALSE(vocab.find("term0", key));
+
+  terms.push_back(bayon::Vocabulary::Term("term0", 0));
+  EXPECT_TRUE(vocab.build(terms));
+  EXPECT_TRUE(vocab.find("term0", key));
+  EXPECT_EQ(vocab.size(), 1U);
+
+  terms.push_back(bayon::Vocabulary::Term("term0", 1));
+  EXPECT_FALSE(vocab.build(terms));
+  EXPECT_EQ(vocab.size(), 0U);
+  EXPECT_FALSE(vocab.find("term0", key));
+}
+
+/* FeatureHasher::find */
+TEST(FeatureHasherTest, FindTest) {
+  bayon::FeatureHasher hasher(4, false);
+  EXPECT_EQ(hasher.size(), 16U);
+  bayon::VecValue sign;
+  bayon::VecKey key = hasher.find("term0", sign);
+  EXPECT_TRUE(key >= 0 && key < 16);
+  EXPECT_EQ(sign, 1.0);
+  bayon::VecValue sign2;
+  std::string line("term0\t1");
+  EXPECT_EQ(hasher.find(line.data(), 5, sign2), key);
+
+  bayon::FeatureHasher signed_hasher(4, true);
+  size_t npositive = 0, nnegative = 0;
+  char buf[32];
+  for (int i = 0; i < 100; i++) {
+    snprintf(buf, sizeof(buf), "term%d", i);
+    EXPECT_EQ(signed_hasher.find(buf, sign), hasher.find(buf, sign2));
+    if (sign > 0) npositive++;
+    else          nnegative++;
+    EXPECT_EQ(sign * sign, 1.0);
+  }
+  EXPECT_GT(npositive, 0U);
+  EXPECT_GT(nnegative, 0U);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}